@@ -5,36 +5,156 @@
 
 using namespace Rcpp;
 
+// rcpp_osmdata_parse
+SEXP rcpp_osmdata_parse(const std::string& st, Rcpp::List opts);
+RcppExport SEXP _osmdata_rcpp_osmdata_parse(SEXP stSEXP, SEXP optsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type st(stSEXP);
+    Rcpp::traits::input_parameter< Rcpp::List >::type opts(optsSEXP);
+    rcpp_result_gen = Rcpp::wrap(rcpp_osmdata_parse(st, opts));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rcpp_osmdata_parse_file
+SEXP rcpp_osmdata_parse_file(const std::string& filename, Rcpp::List opts);
+RcppExport SEXP _osmdata_rcpp_osmdata_parse_file(SEXP filenameSEXP, SEXP optsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type filename(filenameSEXP);
+    Rcpp::traits::input_parameter< Rcpp::List >::type opts(optsSEXP);
+    rcpp_result_gen = Rcpp::wrap(rcpp_osmdata_parse_file(filename, opts));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rcpp_osmdata_handle_info
+Rcpp::List rcpp_osmdata_handle_info(SEXP handle);
+RcppExport SEXP _osmdata_rcpp_osmdata_handle_info(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    rcpp_result_gen = Rcpp::wrap(rcpp_osmdata_handle_info(handle));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rcpp_osmdata_handle_sf
+Rcpp::List rcpp_osmdata_handle_sf(SEXP handle);
+RcppExport SEXP _osmdata_rcpp_osmdata_handle_sf(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    rcpp_result_gen = Rcpp::wrap(rcpp_osmdata_handle_sf(handle));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rcpp_osmdata_handle_sp
+Rcpp::List rcpp_osmdata_handle_sp(SEXP handle);
+RcppExport SEXP _osmdata_rcpp_osmdata_handle_sp(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    rcpp_result_gen = Rcpp::wrap(rcpp_osmdata_handle_sp(handle));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rcpp_osmdata_handle_sc
+Rcpp::List rcpp_osmdata_handle_sc(SEXP handle, const bool integer_ids);
+RcppExport SEXP _osmdata_rcpp_osmdata_handle_sc(SEXP handleSEXP, SEXP integer_idsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    Rcpp::traits::input_parameter< const bool >::type integer_ids(integer_idsSEXP);
+    rcpp_result_gen = Rcpp::wrap(rcpp_osmdata_handle_sc(handle, integer_ids));
+    return rcpp_result_gen;
+END_RCPP
+}
 // rcpp_osmdata_sc
-Rcpp::List rcpp_osmdata_sc(const std::string& st);
-RcppExport SEXP _osmdata_rcpp_osmdata_sc(SEXP stSEXP) {
+Rcpp::List rcpp_osmdata_sc(const std::string& st, Rcpp::List opts);
+RcppExport SEXP _osmdata_rcpp_osmdata_sc(SEXP stSEXP, SEXP optsSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< const std::string& >::type st(stSEXP);
-    rcpp_result_gen = Rcpp::wrap(rcpp_osmdata_sc(st));
+    Rcpp::traits::input_parameter< Rcpp::List >::type opts(optsSEXP);
+    rcpp_result_gen = Rcpp::wrap(rcpp_osmdata_sc(st, opts));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rcpp_osmdata_sc_file
+Rcpp::List rcpp_osmdata_sc_file(const std::string& filename, Rcpp::List opts);
+RcppExport SEXP _osmdata_rcpp_osmdata_sc_file(SEXP filenameSEXP, SEXP optsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type filename(filenameSEXP);
+    Rcpp::traits::input_parameter< Rcpp::List >::type opts(optsSEXP);
+    rcpp_result_gen = Rcpp::wrap(rcpp_osmdata_sc_file(filename, opts));
     return rcpp_result_gen;
 END_RCPP
 }
 // rcpp_osmdata_sf
-Rcpp::List rcpp_osmdata_sf(const std::string& st);
-RcppExport SEXP _osmdata_rcpp_osmdata_sf(SEXP stSEXP) {
+Rcpp::List rcpp_osmdata_sf(const std::string& st, Rcpp::List opts);
+RcppExport SEXP _osmdata_rcpp_osmdata_sf(SEXP stSEXP, SEXP optsSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< const std::string& >::type st(stSEXP);
-    rcpp_result_gen = Rcpp::wrap(rcpp_osmdata_sf(st));
+    Rcpp::traits::input_parameter< Rcpp::List >::type opts(optsSEXP);
+    rcpp_result_gen = Rcpp::wrap(rcpp_osmdata_sf(st, opts));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rcpp_osmdata_sf_file
+Rcpp::List rcpp_osmdata_sf_file(const std::string& filename, Rcpp::List opts);
+RcppExport SEXP _osmdata_rcpp_osmdata_sf_file(SEXP filenameSEXP, SEXP optsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type filename(filenameSEXP);
+    Rcpp::traits::input_parameter< Rcpp::List >::type opts(optsSEXP);
+    rcpp_result_gen = Rcpp::wrap(rcpp_osmdata_sf_file(filename, opts));
     return rcpp_result_gen;
 END_RCPP
 }
 // rcpp_osmdata_sp
-Rcpp::List rcpp_osmdata_sp(const std::string& st);
-RcppExport SEXP _osmdata_rcpp_osmdata_sp(SEXP stSEXP) {
+Rcpp::List rcpp_osmdata_sp(const std::string& st, Rcpp::List opts);
+RcppExport SEXP _osmdata_rcpp_osmdata_sp(SEXP stSEXP, SEXP optsSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< const std::string& >::type st(stSEXP);
-    rcpp_result_gen = Rcpp::wrap(rcpp_osmdata_sp(st));
+    Rcpp::traits::input_parameter< Rcpp::List >::type opts(optsSEXP);
+    rcpp_result_gen = Rcpp::wrap(rcpp_osmdata_sp(st, opts));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rcpp_osmdata_sp_file
+Rcpp::List rcpp_osmdata_sp_file(const std::string& filename, Rcpp::List opts);
+RcppExport SEXP _osmdata_rcpp_osmdata_sp_file(SEXP filenameSEXP, SEXP optsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type filename(filenameSEXP);
+    Rcpp::traits::input_parameter< Rcpp::List >::type opts(optsSEXP);
+    rcpp_result_gen = Rcpp::wrap(rcpp_osmdata_sp_file(filename, opts));
+    return rcpp_result_gen;
+END_RCPP
+}
+// rcpp_test_parse_num
+Rcpp::List rcpp_test_parse_num(const std::vector<std::string>& x, bool integer);
+RcppExport SEXP _osmdata_rcpp_test_parse_num(SEXP xSEXP, SEXP integerSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::vector<std::string>& >::type x(xSEXP);
+    Rcpp::traits::input_parameter< bool >::type integer(integerSEXP);
+    rcpp_result_gen = Rcpp::wrap(rcpp_test_parse_num(x, integer));
     return rcpp_result_gen;
 END_RCPP
 }
@@ -0,0 +1,184 @@
+/***************************************************************************
+ *  Project:    osmdata
+ *  File:       arena.h
+ *  Language:   C++
+ *
+ *  osmdata is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  osmdata is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along with
+ *  osm-router.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Author:     Mark Padgham
+ *  E-Mail:     mark.padgham@email.com
+ *
+ *  Description:    Monotonic (bump) allocation of the many small containers
+ *                  held by each parsed object, all of which are released
+ *                  together with the dataset.
+ *
+ *  Limitations:    Memory is never reused until the whole arena is released,
+ *                  so containers allocated here should be sized once rather
+ *                  than grown.
+ *
+ *  Dependencies:       none
+ *
+ *  Compiler Options:   -std=c++11
+ ***************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+/************************************************************************
+ ************************************************************************
+ **                                                                    **
+ **                            CLASS::ARENA                            **
+ **                                                                    **
+ ************************************************************************
+ ************************************************************************
+ *
+ * Memory is handed out sequentially from blocks which double in size up to
+ * MAX_BLOCK. Requests larger than a quarter of the current block size are
+ * given blocks of their own, so that they do not waste the remainder of the
+ * current block.
+ */
+
+class Arena
+{
+    private:
+
+        static constexpr size_t MIN_BLOCK = 1 << 16;
+        static constexpr size_t MAX_BLOCK = 1 << 24;
+
+        std::vector <std::unique_ptr <char []> > m_blocks;
+        char * m_p = nullptr;
+        size_t m_left = 0, m_block_size = MIN_BLOCK, m_bytes = 0;
+
+        char * new_block (size_t n)
+        {
+            m_blocks.emplace_back (new char [n]);
+            m_bytes += n;
+            return m_blocks.back ().get ();
+        }
+
+    public:
+
+        Arena () {}
+        Arena (const Arena &) = delete;
+        Arena& operator= (const Arena &) = delete;
+
+        void * allocate (size_t n, size_t align)
+        {
+            if (n == 0)
+                n = 1;
+            if (n + align > m_block_size / 4)
+                return new_block (n); // aligned as for operator new
+
+            size_t pad = static_cast <size_t> (-reinterpret_cast <uintptr_t> (m_p)) &
+                (align - 1);
+            if (m_p == nullptr || pad + n > m_left)
+            {
+                m_p = new_block (m_block_size);
+                m_left = m_block_size;
+                if (m_block_size < MAX_BLOCK)
+                    m_block_size *= 2;
+                pad = 0;
+            }
+            char * res = m_p + pad;
+            m_p += pad + n;
+            m_left -= pad + n;
+            return res;
+        }
+
+        // Free all memory, invalidating everything allocated from the arena
+        void release ()
+        {
+            m_blocks.clear ();
+            m_p = nullptr;
+            m_left = m_bytes = 0;
+            m_block_size = MIN_BLOCK;
+        }
+
+        // Total bytes held
+        size_t bytes () const { return m_bytes; }
+};
+
+/************************************************************************
+ ************************************************************************
+ **                                                                    **
+ **                        CLASS::ARENAALLOCATOR                       **
+ **                                                                    **
+ ************************************************************************
+ ************************************************************************
+ *
+ * Standard allocator drawing from an Arena. Deallocation does nothing. A
+ * default-constructed allocator has no arena, and falls back to the global
+ * operator new, as do all copies of arena-allocated containers, so that they
+ * may safely outlive the arena.
+ */
+
+template <typename T>
+class ArenaAllocator
+{
+    private:
+
+        Arena * m_arena = nullptr;
+
+        template <typename U> friend class ArenaAllocator;
+
+    public:
+
+        typedef T value_type;
+        typedef std::true_type propagate_on_container_move_assignment;
+        typedef std::true_type propagate_on_container_swap;
+
+        ArenaAllocator () {}
+        explicit ArenaAllocator (Arena * arena) : m_arena (arena) {}
+        template <typename U>
+        ArenaAllocator (const ArenaAllocator <U> &other)
+            : m_arena (other.m_arena) {}
+
+        T * allocate (size_t n)
+        {
+            if (m_arena == nullptr)
+                return static_cast <T *> (::operator new (n * sizeof (T)));
+            return static_cast <T *> (m_arena->allocate (n * sizeof (T),
+                        alignof (T)));
+        }
+
+        void deallocate (T * p, size_t)
+        {
+            if (m_arena == nullptr)
+                ::operator delete (p);
+        }
+
+        ArenaAllocator select_on_container_copy_construction () const
+        {
+            return ArenaAllocator ();
+        }
+
+        Arena * arena () const { return m_arena; }
+
+        template <typename U>
+        bool operator== (const ArenaAllocator <U> &other) const
+        {
+            return m_arena == other.m_arena;
+        }
+        template <typename U>
+        bool operator!= (const ArenaAllocator <U> &other) const
+        {
+            return m_arena != other.m_arena;
+        }
+};
@@ -23,19 +23,21 @@
  *
  *  Limitations:
  *
- *  Dependencies:       none (rapidXML header included in osmdata)
+ *  Dependencies:       none
  *
  *  Compiler Options:   -std=c++11
  ***************************************************************************/
 
 #pragma once
 
-#include "rapidxml.h"
-
 // APS not good pratice to have all the headers included here, adds to compile time
 // better to #include as and where needed, ideally in source rather than headers,
 // and use fwd declarations wherever possible
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
 #include <limits>
 #include <memory>
 #include <string>
@@ -44,9 +46,14 @@
 #include <map>
 #include <set>
 #include <unordered_set>
+#include <unordered_map>
+#include <stdexcept>
 #include <cstring>
 #include <sstream>
 
+#include "arena.h"
+#include "xml-stream.h"
+
 // APS uncomment to save xml input string to a file
 //#define DUMP_INPUT
 #ifdef DUMP_INPUT
@@ -69,45 +76,131 @@ typedef std::vector <std::pair <osmid_t, std::string> >::iterator it_osm_str_vec
 
 constexpr float FLOAT_MAX =  std::numeric_limits<float>::max ();
 constexpr double DOUBLE_MAX =  std::numeric_limits<double>::max ();
+// Index of way nodes which are not present in the data
+constexpr uint32_t MISSING_NODE = std::numeric_limits<uint32_t>::max ();
 
-// Convenience typedefs for some rapidxml types
-typedef std::unique_ptr<rapidxml::xml_document<> > XmlDocPtr;
-typedef const rapidxml::xml_node<>* XmlNodePtr;
-typedef const rapidxml::xml_attribute<>* XmlAttrPtr;
+/* A non-owning view of a string, pointing either into the input buffer, or
+ * into storage held until the objects containing the view have been
+ * processed. */
+struct StrView
+{
+    const char * data = nullptr;
+    size_t size = 0;
 
-// ----- functions in common.cpp
-XmlDocPtr parseXML (const std::string& xmlString);
-// ----- end functions in common.cpp
+    StrView () {}
+    StrView (const char * d, size_t n) : data (d), size (n) {}
+    StrView (const std::string &s) : data (s.data ()), size (s.size ()) {}
 
-struct UniqueVals
+    std::string str () const { return std::string (data, size); }
+
+    bool operator== (const StrView &other) const
+    {
+        return size == other.size &&
+            (size == 0 || !memcmp (data, other.data, size));
+    }
+    bool operator== (const char * s) const
+    {
+        return strlen (s) == size && (size == 0 || !strncmp (data, s, size));
+    }
+};
+
+// FNV-1a
+struct StrViewHash
 {
-    // OSM IDs are sometimes duplicated, even though they ought not be. Unique
-    // IDs are stored in the following sets, ensuring that only the first
-    // instance of any given ID will be extracted. Using set.find in constructed
-    // takes 45ms for trial code; time without these finds = 60ms - HUH?
-    // NOTE: Previous code converted <osmid_t> IDs to std::string and added
-    // decimal places to generate unique IDs. This could be re-instated?
-    std::set <osmid_t> id_node, id_way, id_rel;
-    // Unique keys are also stored to provide column names.  Although std::set
-    // is slower than an unordered_set, it is useful to have keys alphabetically
-    // ordered.
-    std::set <std::string> k_point, k_way, k_rel;
-    // A numeric index is also constructed to enable direct indexing into
-    // key-val matrices. This is an unsigned int for indexing into Rcpp objects.
-    std::map <std::string, unsigned int> k_point_index, k_way_index, k_rel_index;
+    size_t operator() (const StrView &s) const
+    {
+        uint64_t h = 14695981039346656037ULL;
+        for (size_t i = 0; i < s.size; i++)
+        {
+            h ^= static_cast <unsigned char> (s.data [i]);
+            h *= 1099511628211ULL;
+        }
+        return static_cast <size_t> (h);
+    }
 };
 
-struct RawNode
+/************************************************************************
+ ************************************************************************
+ **                                                                    **
+ **                          CLASS::DICTIONARY                         **
+ **                                                                    **
+ ************************************************************************
+ ************************************************************************
+ *
+ * Interned strings, each stored once and referred to by a 32-bit id. Ids are
+ * allocated in order of first appearance. Strings are looked up by views, so
+ * only those not already present are ever copied. They are held in a deque,
+ * the elements of which are never moved, even when the dictionary itself is
+ * moved, and so the index may refer to them by view. The dictionary can thus
+ * be moved but not copied.
+ */
+
+class Dictionary
 {
-    osmid_t id;
-    std::vector <std::string> key, value;
-    double lat, lon;
+    private:
+
+        std::deque <std::string> m_str;
+        std::unordered_map <StrView, uint32_t, StrViewHash> m_index;
+
+    public:
+
+        Dictionary () {}
+        Dictionary (const Dictionary &) = delete;
+        Dictionary& operator= (const Dictionary &) = delete;
+        Dictionary (Dictionary &&) = default;
+        Dictionary& operator= (Dictionary &&) = default;
+
+        size_t size () const { return m_str.size (); }
+        const std::string& str (uint32_t i) const { return m_str [i]; }
+
+        uint32_t id (const StrView &s)
+        {
+            auto it = m_index.find (s);
+            if (it != m_index.end ())
+                return it->second;
+            if (m_str.size () >= std::numeric_limits <uint32_t>::max ())
+                throw std::runtime_error ("too many distinct strings");
+            const uint32_t i = static_cast <uint32_t> (m_str.size ());
+            m_str.emplace_back (s.data, s.size);
+            m_index.emplace (StrView (m_str.back ()), i);
+            return i;
+        }
+
+        void clear ()
+        {
+            m_index.clear ();
+            m_str.clear ();
+        }
+};
+
+// Containers held by each parsed object, which are allocated from the arena of
+// the whole dataset
+template <typename T> using ArenaVector = std::vector <T, ArenaAllocator <T> >;
+
+// (key, value) pairs of dictionary ids
+typedef ArenaVector <std::pair <uint32_t, uint32_t> > KeyVals;
+// (id, role) of relation members
+typedef ArenaVector <std::pair <osmid_t, std::string> > RelMembers;
+
+struct UniqueVals
+{
+    // All keys and values, to which all tags refer
+    Dictionary strings;
+    // Unique keys are also stored to provide column names, alphabetically
+    // ordered. These are collected once all data have been read.
+    std::set <std::string> k_point, k_way, k_rel;
+    // A numeric index of the column of each key in the key-val matrices,
+    // addressed by dictionary id. This is an unsigned int for indexing into
+    // Rcpp objects.
+    std::vector <unsigned int> k_point_index, k_way_index, k_rel_index;
 };
 
-struct Node
+/* Strings of all Raw objects are views, which remain valid only until the
+ * objects are added to XmlData. */
+struct RawNode
 {
     osmid_t id;
-    std::map <std::string, std::string> key_val;
+    std::vector <StrView> key, value;
     double lat, lon;
 };
 
@@ -118,24 +211,34 @@ struct Node
 struct RawWay
 {
     osmid_t id;
-    std::vector <std::string> key, value;
+    std::vector <StrView> key, value;
     std::vector <osmid_t> nodes;
 };
 
 struct OneWay
 {
     osmid_t id;
-    std::map <std::string, std::string> key_val;
-    std::vector <osmid_t> nodes;
+    KeyVals key_val; // sorted by key
+    ArenaVector <osmid_t> nodes;
+    // Positions of each of the nodes in the Nodes store, resolved once all
+    // nodes have been read. Any which are missing are MISSING_NODE, and flagged
+    // by missing_nodes, so that geometries need never search for nodes.
+    ArenaVector <uint32_t> node_index;
+    bool missing_nodes = false;
+
+    OneWay (Arena * arena = nullptr)
+        : key_val (KeyVals::allocator_type (arena)),
+          nodes (ArenaVector <osmid_t>::allocator_type (arena)),
+          node_index (ArenaVector <uint32_t>::allocator_type (arena)) {}
 };
 
 struct RawRelation
 {
     bool ispoly;
     osmid_t id;
-    std::string member_type;
+    StrView member_type;
     // APS would (key,value) be better in a std::map?
-    std::vector <std::string> key, value, role_node, role_way, role_relation;
+    std::vector <StrView> key, value, role_node, role_way, role_relation;
     std::vector <osmid_t> nodes;
     std::vector <osmid_t> ways;
     std::vector <osmid_t> relations; // relations can contain relations
@@ -146,18 +249,594 @@ struct Relation
     bool ispoly;
     osmid_t id;
     std::string rel_type;
-    std::map <std::string, std::string> key_val;
+    KeyVals key_val; // sorted by key
     // Relations may have nodes as members, but these are not used here.
-    std::vector <std::pair <osmid_t, std::string> > nodes; // str = role
-    std::vector <std::pair <osmid_t, std::string> > ways; // str = role
-    std::vector <std::pair <osmid_t, std::string> > relations; // str = role
+    RelMembers nodes, ways, relations;
+
+    Relation (Arena * arena = nullptr)
+        : key_val (KeyVals::allocator_type (arena)),
+          nodes (RelMembers::allocator_type (arena)),
+          ways (RelMembers::allocator_type (arena)),
+          relations (RelMembers::allocator_type (arena)) {}
+};
+
+/* Elements read from one part of an input file (a chunk of XML, or a PBF
+ * PrimitiveBlock), held in order until they are merged into XmlData. This
+ * provides the same add_* interface as XmlData, so that either can receive
+ * elements as they are read.
+ *
+ * The strings of all elements are views into the input, or into `buffer` for
+ * decompressed PBF data, or into `decoded` for XML values in which character
+ * entities have been translated. The block must therefore remain in place
+ * until it has been merged. */
+struct RawBlock
+{
+    std::vector <RawNode> nodes;
+    std::vector <RawWay> ways;
+    std::vector <RawRelation> relations;
+
+    std::vector <char> buffer; // not cleared, so that it can be decoded into
+    std::deque <std::string> decoded;
+
+    void clear ()
+    {
+        nodes.clear ();
+        ways.clear ();
+        relations.clear ();
+        decoded.clear ();
+    }
+
+    StrView keep (std::string &&s)
+    {
+        decoded.push_back (std::move (s));
+        return StrView (decoded.back ());
+    }
+
+    void add_node (RawNode &rnode) { nodes.push_back (std::move (rnode)); }
+    void add_way (RawWay &rway) { ways.push_back (std::move (rway)); }
+    void add_relation (RawRelation &rrel)
+    {
+        relations.push_back (std::move (rrel));
+    }
 };
 
 typedef std::vector <Relation> Relations;
-typedef std::map <osmid_t, OneWay> Ways;
+typedef std::map <osmid_t, OneWay, std::less <osmid_t>,
+        ArenaAllocator <std::pair <const osmid_t, OneWay> > > Ways;
+
+/************************************************************************
+ ************************************************************************
+ **                                                                    **
+ **                           CLASS::IDINDEX                           **
+ **                                                                    **
+ ************************************************************************
+ ************************************************************************
+ *
+ * Open-addressing hash index of objects held in some sequential container.
+ * Only 32-bit positions in the container are stored, so each function is
+ * passed `id_of`, which returns the id of the object at a given position.
+ */
+
+class IdIndex
+{
+    private:
+
+        static constexpr uint32_t EMPTY = std::numeric_limits <uint32_t>::max ();
+
+        std::vector <uint32_t> m_slots; // size is a power of two
+        size_t m_n = 0;
+
+        size_t slot (osmid_t id) const
+        {
+            uint64_t h = static_cast <uint64_t> (id) * 0x9E3779B97F4A7C15ULL;
+            return static_cast <size_t> (h ^ (h >> 32)) & (m_slots.size () - 1);
+        }
+
+        template <typename F>
+        void grow (const F &id_of)
+        {
+            const uint32_t empty = EMPTY; // not odr-used before C++17
+            std::vector <uint32_t> old (std::max (m_slots.size () * 2,
+                        static_cast <size_t> (1024)), empty);
+            std::swap (m_slots, old);
+            for (auto i: old)
+                if (i != EMPTY)
+                {
+                    size_t s = slot (id_of (i));
+                    while (m_slots [s] != EMPTY)
+                        s = (s + 1) & (m_slots.size () - 1);
+                    m_slots [s] = i;
+                }
+        }
+
+    public:
+
+        static constexpr size_t npos = static_cast <size_t> (-1);
+
+        bool empty () const { return m_n == 0; }
+
+        // Position of the object with `id`, or npos
+        template <typename F>
+        size_t find (osmid_t id, const F &id_of) const
+        {
+            if (m_slots.empty ())
+                return npos;
+            for (size_t s = slot (id); m_slots [s] != EMPTY;
+                    s = (s + 1) & (m_slots.size () - 1))
+                if (id_of (m_slots [s]) == id)
+                    return m_slots [s];
+            return npos;
+        }
+
+        // Index the object at position `i`, which must not already be present
+        template <typename F>
+        void insert (size_t i, const F &id_of)
+        {
+            if (i >= EMPTY)
+                throw std::runtime_error ("too many objects to index");
+            if (2 * (m_n + 1) > m_slots.size ())
+                grow (id_of);
+            size_t s = slot (id_of (static_cast <uint32_t> (i)));
+            while (m_slots [s] != EMPTY)
+                s = (s + 1) & (m_slots.size () - 1);
+            m_slots [s] = static_cast <uint32_t> (i);
+            m_n++;
+        }
+
+        void clear ()
+        {
+            m_slots.clear ();
+            m_slots.shrink_to_fit ();
+            m_n = 0;
+        }
+};
+
+/************************************************************************
+ ************************************************************************
+ **                                                                    **
+ **                           CLASS::COORDS                            **
+ **                                                                    **
+ ************************************************************************
+ ************************************************************************
+ *
+ * One coordinate (longitude or latitude) of a sequence of points. These are
+ * held as doubles, or, in compact mode, as 32-bit integers of 1e-7 degrees,
+ * which is the precision of OSM itself, and which halves their memory. Values
+ * are always passed in and out as doubles; those with at most 7 decimal places
+ * are returned exactly as they would be read from the input. Compact mode must
+ * be set while the container is empty.
+ */
+
+class Coords
+{
+    private:
+
+        std::vector <double> m_dbl;
+        std::vector <int32_t> m_fixed;
+        bool m_compact = false;
+
+        static constexpr double SCALE = 1e7;
+
+        static int32_t to_fixed (double x)
+        {
+            const double f = std::round (x * SCALE);
+            if (!(std::fabs (f) <= std::numeric_limits <int32_t>::max ()))
+                throw std::runtime_error ("coordinate out of range for "
+                        "compact storage");
+            return static_cast <int32_t> (f);
+        }
+
+    public:
+
+        Coords (bool compact = false) : m_compact (compact) {}
+
+        bool compact () const { return m_compact; }
+        void set_compact (bool compact)
+        {
+            if (size () > 0)
+                throw std::runtime_error ("Coords must be empty to change mode");
+            m_compact = compact;
+        }
+
+        size_t size () const
+        {
+            return m_compact ? m_fixed.size () : m_dbl.size ();
+        }
 
-// MP: osmid_t (long long) is Node.id, and thus repetitive, but traverseNode has
-// to store the ID in the Node struct first, before this can be used to make the
-// map of Nodes. TODO: Is there a better way?
-typedef std::map <osmid_t, Node> Nodes;
+        double operator[] (size_t i) const
+        {
+            return m_compact ? m_fixed [i] / SCALE : m_dbl [i];
+        }
+
+        void set (size_t i, double x)
+        {
+            if (m_compact)
+                m_fixed [i] = to_fixed (x);
+            else
+                m_dbl [i] = x;
+        }
+
+        void push_back (double x)
+        {
+            if (m_compact)
+                m_fixed.push_back (to_fixed (x));
+            else
+                m_dbl.push_back (x);
+        }
+
+        // Append value i of `other`, which must be in the same mode
+        void push_back (const Coords &other, size_t i)
+        {
+            if (m_compact)
+                m_fixed.push_back (other.m_fixed [i]);
+            else
+                m_dbl.push_back (other.m_dbl [i]);
+        }
+
+        // Overwrite value `to` with value `from`
+        void copy (size_t to, size_t from)
+        {
+            if (m_compact)
+                m_fixed [to] = m_fixed [from];
+            else
+                m_dbl [to] = m_dbl [from];
+        }
+
+        void resize (size_t n)
+        {
+            if (m_compact)
+                m_fixed.resize (n);
+            else
+                m_dbl.resize (n);
+        }
+
+        void reserve (size_t n)
+        {
+            if (m_compact)
+                m_fixed.reserve (n);
+            else
+                m_dbl.reserve (n);
+        }
+
+        void clear ()
+        {
+            m_dbl.clear ();
+            m_fixed.clear ();
+        }
+
+        // Write all values as doubles to `out`, which must hold size () values
+        void copy_to (double * out) const
+        {
+            if (m_compact)
+                for (size_t i = 0; i < m_fixed.size (); i++)
+                    out [i] = m_fixed [i] / SCALE;
+            else
+                std::copy (m_dbl.begin (), m_dbl.end (), out);
+        }
+};
+
+/************************************************************************
+ ************************************************************************
+ **                                                                    **
+ **                            CLASS::NODES                            **
+ **                                                                    **
+ ************************************************************************
+ ************************************************************************
+ *
+ * Flat store of all nodes, with ids, longitudes, and latitudes in parallel
+ * arrays, and the dictionary ids of key-value pairs in one compressed block
+ * indexed by the offsets in `m_kv_start`. Nodes are appended with `add ()` in
+ * any order, after which `finalise ()` must be called to sort them by id.
+ * Nodes are then addressed by index, from 0 to `size () - 1`, in order of id.
+ *
+ * `find ()` may also be used while nodes are being added, so that duplicate
+ * ids can be skipped. Nodes generally arrive in order of id, and are then
+ * found by binary search. A hash index is only built once any node arrives
+ * out of order, and is discarded again by `finalise ()`.
+ */
+
+class Nodes
+{
+    private:
+
+        std::vector <osmid_t> m_id;
+        Coords m_lon, m_lat;
+        std::vector <size_t> m_kv_start {0};
+        std::vector <uint32_t> m_key, m_value;
+
+        bool m_sorted = true;
+        IdIndex m_index; // only when !m_sorted
+
+        osmid_t id_at (uint32_t i) const { return m_id [i]; }
+        void push_id (osmid_t id);
+        void make_index ();
+
+    public:
+
+        static constexpr size_t npos = static_cast <size_t> (-1);
+
+        size_t size () const { return m_id.size (); }
+        bool empty () const { return m_id.empty (); }
+
+        // Store coordinates as fixed-point integers; see Coords
+        void set_compact (bool compact)
+        {
+            m_lon.set_compact (compact);
+            m_lat.set_compact (compact);
+        }
+        bool compact () const { return m_lon.compact (); }
+
+        osmid_t id (size_t i) const { return m_id [i]; }
+        double lon (size_t i) const { return m_lon [i]; }
+        double lat (size_t i) const { return m_lat [i]; }
+
+        // Key-value pairs of node i are those from kv_begin (i) to kv_end (i)
+        size_t kv_begin (size_t i) const { return m_kv_start [i]; }
+        size_t kv_end (size_t i) const { return m_kv_start [i + 1]; }
+        uint32_t key (size_t j) const { return m_key [j]; }
+        uint32_t value (size_t j) const { return m_value [j]; }
+
+        // Index of node `id`, or npos if there is no such node
+        size_t find (osmid_t id) const
+        {
+            if (!m_sorted)
+                return m_index.find (id,
+                        [this] (uint32_t i) { return id_at (i); });
+            if (m_id.empty () || id > m_id.back ())
+                return npos;
+            auto it = std::lower_bound (m_id.begin (), m_id.end (), id);
+            if (*it != id)
+                return npos;
+            return static_cast <size_t> (it - m_id.begin ());
+        }
+
+        void clear ()
+        {
+            m_id.clear ();
+            m_lon.clear ();
+            m_lat.clear ();
+            m_kv_start.assign (1, 0);
+            m_key.clear ();
+            m_value.clear ();
+            m_sorted = true;
+            m_index.clear ();
+        }
+
+        void add (osmid_t id, double lon, double lat, const KeyVals &kv);
+        // Append node i of another store
+        void add (const Nodes &nodes, size_t i);
+        void finalise ();
+        // Retain only those nodes for which keep [i] is true
+        void filter (const std::vector <bool> &keep);
+};
+
+inline void Nodes::push_id (osmid_t id)
+{
+    if (m_sorted && !m_id.empty () && id <= m_id.back ())
+    {
+        m_sorted = false;
+        make_index ();
+    }
+    m_id.push_back (id);
+    if (!m_sorted)
+        m_index.insert (m_id.size () - 1,
+                [this] (uint32_t i) { return id_at (i); });
+}
+
+inline void Nodes::make_index ()
+{
+    m_index.clear ();
+    for (size_t i = 0; i < m_id.size (); i++)
+        m_index.insert (i, [this] (uint32_t j) { return id_at (j); });
+}
+
+inline void Nodes::add (osmid_t id, double lon, double lat, const KeyVals &kv)
+{
+    push_id (id);
+    m_lon.push_back (lon);
+    m_lat.push_back (lat);
+    for (auto &p: kv)
+    {
+        m_key.push_back (p.first);
+        m_value.push_back (p.second);
+    }
+    m_kv_start.push_back (m_key.size ());
+}
+
+inline void Nodes::add (const Nodes &nodes, size_t i)
+{
+    push_id (nodes.m_id [i]);
+    m_lon.push_back (nodes.m_lon, i);
+    m_lat.push_back (nodes.m_lat, i);
+    for (size_t j = nodes.kv_begin (i); j < nodes.kv_end (i); j++)
+    {
+        m_key.push_back (nodes.m_key [j]);
+        m_value.push_back (nodes.m_value [j]);
+    }
+    m_kv_start.push_back (m_key.size ());
+}
+
+inline void Nodes::finalise ()
+{
+    // OSM data are generally already sorted by id
+    if (m_sorted)
+        return;
+
+    std::vector <size_t> index (m_id.size ());
+    for (size_t i = 0; i < index.size (); i++)
+        index [i] = i;
+    std::stable_sort (index.begin (), index.end (),
+            [this] (size_t a, size_t b) { return m_id [a] < m_id [b]; });
+
+    Nodes sorted;
+    sorted.set_compact (compact ());
+    sorted.m_id.reserve (m_id.size ());
+    sorted.m_lon.reserve (m_id.size ());
+    sorted.m_lat.reserve (m_id.size ());
+    sorted.m_kv_start.reserve (m_kv_start.size ());
+    sorted.m_key.reserve (m_key.size ());
+    sorted.m_value.reserve (m_key.size ());
+    for (auto i: index)
+        sorted.add (*this, i);
+    std::swap (*this, sorted);
+}
+
+inline void Nodes::filter (const std::vector <bool> &keep)
+{
+    size_t n = 0, nkv = 0;
+    for (size_t i = 0; i < m_id.size (); i++)
+    {
+        if (!keep [i])
+            continue;
+        m_id [n] = m_id [i];
+        m_lon.copy (n, i);
+        m_lat.copy (n, i);
+        for (size_t j = m_kv_start [i]; j < m_kv_start [i + 1]; j++)
+        {
+            m_key [nkv] = m_key [j];
+            m_value [nkv] = m_value [j];
+            nkv++;
+        }
+        m_kv_start [++n] = nkv;
+    }
+    m_id.resize (n);
+    m_lon.resize (n);
+    m_lat.resize (n);
+    m_kv_start.resize (n + 1);
+    m_key.resize (nkv);
+    m_value.resize (nkv);
+    if (!m_sorted)
+        make_index ();
+}
+
+/* Options applied while parsing, so that unwanted data are never stored.
+ * Tags are retained only if their keys are in `keys`, or, if `exclude_keys`
+ * is true, only if they are not. An empty `keys` retains all tags.
+ *
+ * Objects may also be restricted to those within the polygon with vertices
+ * (`poly_x`, `poly_y`), with `exclude` having the same meaning as for the R
+ * function `trim_osmdata`: if true, only objects entirely within the polygon
+ * are retained; otherwise all objects which partly extend within it. */
+struct ParseOptions
+{
+    // Views of the keys, which are owned by key_store. This is shared between
+    // copies of the options, so that the views remain valid in all of them.
+    std::unordered_set <StrView, StrViewHash> keys;
+    std::shared_ptr <std::deque <std::string> > key_store;
+    bool exclude_keys = false;
+
+    std::vector <double> poly_x, poly_y;
+    bool exclude = true;
+
+    // Hold coordinates as fixed-point integers; see Coords
+    bool compact = false;
+
+    // Join the member ways of multilinestring relations which share end nodes
+    // into the longest possible linestrings; see trace_multilinestring
+    bool merge_lines = false;
+
+    // Return identifiers in SC format as integers rather than strings; see
+    // SCId
+    bool integer_ids = false;
+
+    // Size of the chunks into which large XML documents are split to be parsed
+    // in parallel, with 0 for the default of XML_CHUNK_SIZE. Any other value
+    // forces documents to be split even when only one thread is available, and
+    // is intended only for testing.
+    size_t chunk_size = 0;
+
+    bool has_poly () const { return !poly_x.empty (); }
+
+    void add_key (const std::string &key)
+    {
+        if (!key_store)
+            key_store = std::make_shared <std::deque <std::string> > ();
+        key_store->push_back (key); // deque elements never move
+        keys.insert (StrView (key_store->back ()));
+    }
+
+    bool keep_key (const StrView &key) const
+    {
+        if (keys.empty ())
+            return true;
+        return (keys.find (key) != keys.end ()) != exclude_keys;
+    }
+};
+
+/* Position of the point (x, y) relative to the polygon (px, py), with the same
+ * return values as `sp::point.in.polygon`: 0 if exterior, 1 if interior, 2 if
+ * on an edge, and 3 if at a vertex. The polygon may or may not be closed. */
+inline int point_in_polygon (double x, double y,
+        const std::vector <double> &px, const std::vector <double> &py)
+{
+    const size_t n = px.size ();
+    for (size_t i = 0; i < n; i++)
+        if (px [i] == x && py [i] == y)
+            return 3;
+
+    bool inside = false;
+    for (size_t i = 0, j = n - 1; i < n; j = i++)
+    {
+        if ((py [i] > y) != (py [j] > y))
+        {
+            const double xc = px [i] +
+                (y - py [i]) * (px [j] - px [i]) / (py [j] - py [i]);
+            if (x == xc)
+                return 2;
+            if (x < xc)
+                inside = !inside;
+        } else if (py [i] == y && py [j] == y &&
+                (x - px [i]) * (x - px [j]) <= 0.0)
+            return 2; // on a horizontal edge
+    }
+    return inside ? 1 : 0;
+}
+
+// Whether the <tag> whose attributes are `attrs` is to be retained. Any other
+// elements (with no "k" attribute) are always retained. Keys are compared as
+// raw bytes of the input, and only decoded if they contain entities.
+inline bool keep_tag (const xml_stream::Attrs &attrs, const ParseOptions &opts)
+{
+    if (opts.keys.empty ())
+        return true;
+    for (auto it = attrs.begin (); it != attrs.end (); ++it)
+        if (it->name_is ("k"))
+        {
+            if (!it->has_entities ())
+                return opts.keep_key (StrView (it->value, it->value_len));
+            const std::string key = it->str ();
+            return opts.keep_key (StrView (key));
+        }
+    return true;
+}
+
+/* Header metadata of an OSM document, read from the attributes of the <osm>
+ * and <meta> elements during the same traversal as the data themselves.
+ * Values remain empty when the corresponding attributes are absent. */
+struct OsmMeta
+{
+    std::string timestamp; // <meta osm_base="...">
+    std::string osm_version; // <osm version="...">
+    std::string generator; // <osm generator="...">
+};
+
+/* Header elements appear only outside of nodes, ways and relations, and
+ * their attributes are captured identically by XmlData and XmlDataSC. */
+inline void read_osm_meta (const char * name, size_t len,
+        const xml_stream::Attrs &attrs, OsmMeta &meta)
+{
+    if (len == 3 && !strncmp (name, "osm", 3))
+    {
+        for (auto it = attrs.begin (); it != attrs.end (); ++it)
+            if (it->name_is ("version"))
+                meta.osm_version = it->str ();
+            else if (it->name_is ("generator"))
+                meta.generator = it->str ();
+    } else if (len == 4 && !strncmp (name, "meta", 4))
+    {
+        for (auto it = attrs.begin (); it != attrs.end (); ++it)
+            if (it->name_is ("osm_base"))
+                meta.timestamp = it->str ();
+    }
+}
 
@@ -24,12 +24,13 @@
  *
  *  Limitations:
  *
- *  Dependencies:       none (rapidXML header included in osmdatar)
+ *  Dependencies:       none
  *
  *  Compiler Options:   -std=c++11
  ***************************************************************************/
 
 #include "convert-osm-rcpp.h"
+#include "trace-osm.h"
 
 
 /************************************************************************
@@ -61,15 +62,14 @@ void osm_convert::trace_way_nmat (const Ways &ways, const Nodes &nodes,
     rownames.reserve (n);
     nmat = Rcpp::NumericMatrix (Rcpp::Dimension (n, 2));
 
-    size_t tempi = 0;
-    for (auto ni = wayi->second.nodes.begin ();
-            ni != wayi->second.nodes.end (); ++ni)
+    if (wayi->second.missing_nodes)
+        throw std::runtime_error ("node can not be found");
+    for (size_t i = 0; i < n; i++)
     {
-        rownames.push_back (std::to_string (*ni));
-        //nmat (tempi, 0) = static_cast <double> (nodes.find (*ni)->second.lon);
-        //nmat (tempi++, 1) = static_cast <double> (nodes.find (*ni)->second.lat);
-        nmat (tempi, 0) = nodes.find (*ni)->second.lon;
-        nmat (tempi++, 1) = nodes.find (*ni)->second.lat;
+        const uint32_t ni = wayi->second.node_index [i];
+        rownames.push_back (std::to_string (wayi->second.nodes [i]));
+        nmat (i, 0) = nodes.lon (ni);
+        nmat (i, 1) = nodes.lat (ni);
     }
 
     std::vector <std::string> colnames = {"lon", "lat"};
@@ -88,23 +88,19 @@ void osm_convert::trace_way_nmat (const Ways &ways, const Nodes &nodes,
  * @param wayi Constant iterator to one OSM way
  * @param Ways Pointer to the std::vector of all ways
  * @param unique_vals Pointer to the UniqueVals structure
+ * @param strings Cache of R strings for all dictionary entries
  * @param value_arr Pointer to the Rcpp::CharacterMatrix of values to be filled
  *        by tracing the key-val pairs of the way 'wayi'
  * @param rowi Integer value for the key-val pairs for wayi
  */
-// TODO: Is it faster to use a std::vector <std::string> instead of
-// Rcpp::CharacterMatrix and then simply
-// Rcpp::CharacterMatrix mat (nrow, ncol, value_vec.begin ()); ?
 void osm_convert::get_value_mat_way (Ways::const_iterator wayi,
-        const UniqueVals &unique_vals, Rcpp::CharacterMatrix &value_arr,
-        unsigned int rowi)
+        const UniqueVals &unique_vals, StringCache &strings,
+        Rcpp::CharacterMatrix &value_arr, unsigned int rowi)
 {
-    for (auto kv_iter = wayi->second.key_val.begin ();
-            kv_iter != wayi->second.key_val.end (); ++kv_iter)
+    for (auto &kv: wayi->second.key_val)
     {
-        const std::string &key = kv_iter->first;
-        unsigned int coli = unique_vals.k_way_index.at (key);
-        value_arr (rowi, coli) = kv_iter->second;
+        unsigned int coli = unique_vals.k_way_index [kv.first];
+        value_arr (rowi, coli) = strings.get (kv.second);
     }
 }
 
@@ -115,20 +111,19 @@ void osm_convert::get_value_mat_way (Ways::const_iterator wayi,
  * @param reli Constant iterator to one OSM relation
  * @param rels Pointer to the std::vector of all relations
  * @param unique_vals Pointer to the UniqueVals structure
+ * @param strings Cache of R strings for all dictionary entries
  * @param value_arr Pointer to the Rcpp::CharacterMatrix of values to be filled
  *        by tracing the key-val pairs of the relation 'reli'
  * @param rowi Integer value for the key-val pairs for reli
  */
 void osm_convert::get_value_mat_rel (Relations::const_iterator &reli,
-        const UniqueVals &unique_vals, Rcpp::CharacterMatrix &value_arr,
-        unsigned int rowi)
+        const UniqueVals &unique_vals, StringCache &strings,
+        Rcpp::CharacterMatrix &value_arr, unsigned int rowi)
 {
-    for (auto kv_iter = reli->key_val.begin (); kv_iter != reli->key_val.end ();
-            ++kv_iter)
+    for (auto &kv: reli->key_val)
     {
-        const std::string &key = kv_iter->first;
-        unsigned int coli = unique_vals.k_rel_index.at (key);
-        value_arr (rowi, coli) = kv_iter->second;
+        unsigned int coli = unique_vals.k_rel_index [kv.first];
+        value_arr (rowi, coli) = strings.get (kv.second);
     }
 }
 
@@ -211,6 +206,52 @@ Rcpp::CharacterMatrix osm_convert::restructure_kv_mat (Rcpp::CharacterMatrix &kv
     return kv_out;
 }
 
+/* KeyValColumns::as_data_frame
+ *
+ * Form a data.frame of key-value pairs with the same layout as
+ * restructure_kv_mat: a first column of "osm_id", then "name" (where present),
+ * then all other keys. Columns are not copied, only referenced.
+ *
+ * @param ids OSM ids of each row, also used as row names
+ * @param keys Ordered set of keys, one for each column
+ */
+Rcpp::List osm_convert::KeyValColumns::as_data_frame (
+        const std::vector <std::string> &ids,
+        const std::set <std::string> &keys) const
+{
+    if (keys.size () != static_cast <size_t> (m_cols.size ()))
+        throw std::runtime_error ("keys and columns must have same sizes");
+
+    Rcpp::List df (m_cols.size () + 1);
+    std::vector <std::string> names;
+    names.reserve (keys.size () + 1);
+
+    Rcpp::CharacterVector ids_rcpp = Rcpp::wrap (ids);
+    df [0] = ids_rcpp;
+    names.push_back ("osm_id");
+    R_xlen_t col = 1;
+
+    auto ni = keys.find ("name");
+    if (ni != keys.end ())
+    {
+        df [col++] = m_cols [std::distance (keys.begin (), ni)];
+        names.push_back ("name");
+    }
+    R_xlen_t j = 0;
+    for (auto k = keys.begin (); k != keys.end (); ++k, ++j)
+        if (k != ni)
+        {
+            df [col++] = m_cols [j];
+            names.push_back (*k);
+        }
+
+    df.attr ("names") = names;
+    df.attr ("row.names") = ids_rcpp;
+    df.attr ("class") = "data.frame";
+
+    return df;
+}
+
 /* convert_poly_linestring_to_sf
  *
  * Converts the data contained in all the arguments into an Rcpp::List object
@@ -284,10 +325,68 @@ template Rcpp::List osm_convert::convert_poly_linestring_to_sf <std::string> (
         const std::vector <std::vector <std::string> > &id_vec, 
         const std::vector <std::string> &rel_id, const std::string type);
 
+/* convert_multipoly_to_sf
+ *
+ * Converts the traced rings of multipolygon relations into an Rcpp::List
+ * object to be used as the geometry column of a Simple Features Collection.
+ * Rings are nested into polygons by `nest_rings`, so that each inner ring is
+ * held by the polygon of the outer ring which contains it.
+ *
+ * @param lon_arr 3D array of longitudinal coordinates
+ * @param lat_arr 3D array of latgitudinal coordinates
+ * @param rowname_arr 3D array of <osmid_t> IDs for nodes of all (lon,lat)
+ * @param id_vec 2D array of IDs for the ways of each ring
+ * @param rel_id Vector of <osmid_t> IDs for each relation.
+ *
+ * @return An Rcpp::List object of [relation][polygon][ring] data.
+ */
+Rcpp::List osm_convert::convert_multipoly_to_sf (
+        const double_arr3 &lon_arr, const double_arr3 &lat_arr, 
+        const string_arr3 &rowname_arr, const string_arr2 &id_vec,
+        const std::vector <std::string> &rel_id)
+{
+    Rcpp::List outList (lon_arr.size ()); 
+    std::vector <std::string> colnames = {"lat", "lon"}, ring_ids;
+    for (unsigned int i=0; i<lon_arr.size (); i++) // over all relations
+    {
+        std::vector <std::vector <size_t> > polygons =
+            nest_rings (lon_arr [i], lat_arr [i]);
+        Rcpp::List outList_i (polygons.size ());
+        for (unsigned int p=0; p<polygons.size (); p++)
+        {
+            Rcpp::List poly (polygons [p].size ());
+            ring_ids.clear ();
+            unsigned int k = 0;
+            for (auto j: polygons [p]) // over all rings of polygon
+            {
+                size_t n = lon_arr [i][j].size ();
+                Rcpp::NumericMatrix nmat (Rcpp::Dimension (n, 2));
+                std::copy (lon_arr [i][j].begin (), lon_arr [i][j].end (),
+                        nmat.begin ());
+                std::copy (lat_arr [i][j].begin (), lat_arr [i][j].end (),
+                        nmat.begin () + n);
+                nmat.attr ("dimnames") = Rcpp::List::create (rowname_arr [i][j],
+                        colnames);
+                poly [k++] = nmat;
+                ring_ids.push_back (id_vec [i][j]);
+            }
+            poly.attr ("names") = ring_ids;
+            outList_i [p] = poly;
+        }
+        outList_i.attr ("class") =
+            Rcpp::CharacterVector::create ("XY", "MULTIPOLYGON", "sfg");
+        outList [i] = outList_i;
+    }
+    outList.attr ("names") = rel_id;
+
+    return outList;
+}
+
 /* convert_multipoly_to_sp
  *
  * Converts the data contained in all the arguments into a
- * SpatialPolygonsDataFrame
+ * SpatialPolygonsDataFrame. Rings are nested by `nest_rings`, and each outer
+ * ring is followed by the holes which it contains.
  *
  * @param lon_arr 3D array of longitudinal coordinates
  * @param lat_arr 3D array of latgitudinal coordinates
@@ -310,6 +409,7 @@ void osm_convert::convert_multipoly_to_sp (Rcpp::S4 &multipolygons, const Relati
     size_t nrow = lon_arr.size (), ncol = unique_vals.k_rel.size ();
     Rcpp::CharacterMatrix kv_mat (Rcpp::Dimension (nrow, ncol));
     std::fill (kv_mat.begin (), kv_mat.end (), NA_STRING);
+    osm_convert::StringCache strings (unique_vals.strings);
 
     Rcpp::List outList (lon_arr.size ()); 
     Rcpp::NumericMatrix nmat (Rcpp::Dimension (0, 0));
@@ -329,12 +429,25 @@ void osm_convert::convert_multipoly_to_sp (Rcpp::S4 &multipolygons, const Relati
         if (itr->ispoly)
         {
             Rcpp::List outList_i (lon_arr [i].size ()); 
-            // j over all ways, with outer always first followed by inner
-            bool outer = true;
+            // Rings of each polygon in turn, with outer always first followed
+            // by inner
+            std::vector <std::vector <size_t> > nested =
+                nest_rings (lon_arr [i], lat_arr [i]);
+            std::vector <size_t> ring_order;
+            std::vector <bool> ring_outer;
+            for (auto &p: nested)
+                for (size_t r = 0; r < p.size (); r++)
+                {
+                    ring_order.push_back (p [r]);
+                    ring_outer.push_back (r == 0);
+                }
+            std::vector <std::string> ring_ids;
             //std::vector <int> plotorder (lon_arr [i].size ());
             Rcpp::IntegerVector plotorder (lon_arr [i].size ());
-            for (unsigned int j=0; j<lon_arr [i].size (); j++) 
+            for (unsigned int k=0; k<ring_order.size (); k++) 
             {
+                const size_t j = ring_order [k];
+                const bool outer = ring_outer [k];
                 size_t n = lon_arr [i][j].size ();
                 nmat = Rcpp::NumericMatrix (Rcpp::Dimension (n, 2));
                 std::copy (lon_arr [i][j].begin (), lon_arr [i][j].end (),
@@ -349,15 +462,12 @@ void osm_convert::convert_multipoly_to_sp (Rcpp::S4 &multipolygons, const Relati
 
                 Rcpp::S4 poly = Polygon (nmat);
                 poly.slot ("hole") = !outer;
-                poly.slot ("ringDir") = static_cast <int> (1);
-                if (outer)
-                    outer = false;
-                else
-                    poly.slot ("ringDir") = static_cast <int> (-1);
-                outList_i [j] = poly;
-                plotorder [j] = static_cast <int> (j) + 1; // 1-based R values
+                poly.slot ("ringDir") = static_cast <int> (outer ? 1 : -1);
+                outList_i [k] = poly;
+                plotorder [k] = static_cast <int> (k) + 1; // 1-based R values
+                ring_ids.push_back (id_vec [i] [j]);
             }
-            outList_i.attr ("names") = id_vec [i];
+            outList_i.attr ("names") = ring_ids;
 
             Rcpp::S4 polygons = polygons_call.eval ();
             polygons.slot ("Polygons") = outList_i;
@@ -379,7 +489,7 @@ void osm_convert::convert_multipoly_to_sp (Rcpp::S4 &multipolygons, const Relati
             outList [i] = polygons;
             rel_id.push_back (std::to_string (itr->id));
 
-            osm_convert::get_value_mat_rel (itr, unique_vals, kv_mat, i++);
+            osm_convert::get_value_mat_rel (itr, unique_vals, strings, kv_mat, i++);
         } // end if ispoly & for i
     outList.attr ("names") = rel_id;
 
@@ -445,6 +555,7 @@ void osm_convert::convert_multiline_to_sp (Rcpp::S4 &multilines, const Relations
     size_t ncol = unique_vals.k_rel.size ();
     Rcpp::CharacterMatrix kv_mat (Rcpp::Dimension (nlines, ncol));
     std::fill (kv_mat.begin (), kv_mat.end (), NA_STRING);
+    osm_convert::StringCache strings (unique_vals.strings);
 
     unsigned int i = 0;
     for (auto itr = rels.begin (); itr != rels.end (); itr++)
@@ -479,7 +590,7 @@ void osm_convert::convert_multiline_to_sp (Rcpp::S4 &multilines, const Relations
             outList [i] = lines;
             rel_id.push_back (std::to_string (itr->id));
 
-            osm_convert::get_value_mat_rel (itr, unique_vals, kv_mat, i++);
+            osm_convert::get_value_mat_rel (itr, unique_vals, strings, kv_mat, i++);
         } // end if ispoly & for i
     outList.attr ("names") = rel_id;
 
@@ -545,14 +656,93 @@ void osm_convert::convert_relation_to_sc (string_arr2 &members_out,
         }
         
         // And then key-value pairs
-        for (auto kv_iter = itr->key_val.begin ();
-                kv_iter != itr->key_val.end (); ++kv_iter)
+        for (auto &kv: itr->key_val)
         {
-            const std::string &key = kv_iter->first;
             long int coli = static_cast <long int> (
-                    unique_vals.k_rel_index.at (key));
-            kv_out [coli] [rowi] = kv_iter->second;
+                    unique_vals.k_rel_index [kv.first]);
+            kv_out [coli] [rowi] = unique_vals.strings.str (kv.second);
         }
         rowi++;
     } // end for itr
 }
+
+/* coords_to_Rcpp
+ *
+ * Converts coordinates, which may be held as fixed-point integers, to an R
+ * numeric vector in a single pass.
+ *
+ * @param coords Coords of either mode
+ *
+ * @return Rcpp::NumericVector of the coordinates as doubles
+ */
+Rcpp::NumericVector osm_convert::coords_to_Rcpp (const Coords &coords)
+{
+    Rcpp::NumericVector res (coords.size ());
+    coords.copy_to (res.begin ());
+    return res;
+}
+
+/* convert_meta_to_Rcpp
+ *
+ * Converts the header metadata of an OSM document into a named character
+ * vector, with names matching those of the 'meta' component of osmdata
+ * objects.
+ *
+ * @param meta OsmMeta captured while parsing the document
+ *
+ * @return Rcpp::CharacterVector of (timestamp, OSM_version, overpass_version)
+ */
+Rcpp::CharacterVector osm_convert::convert_meta_to_Rcpp (const OsmMeta &meta)
+{
+    Rcpp::CharacterVector res = Rcpp::CharacterVector::create (
+            Rcpp::Named ("timestamp") = meta.timestamp,
+            Rcpp::Named ("OSM_version") = meta.osm_version,
+            Rcpp::Named ("overpass_version") = meta.generator);
+    return res;
+}
+
+/* get_parse_options
+ *
+ * Converts the list of parsing options constructed by the R function
+ * `parse_options` into a ParseOptions structure. Missing elements retain
+ * their default values, so an empty list retains all data.
+ *
+ * @param opts Rcpp::List with optional elements 'keys' (character),
+ *        'exclude_keys' (logical), 'poly_x' and 'poly_y' (numeric vertices of
+ *        a bounding polygon), 'exclude', 'compact', 'merge_lines', and
+ *        'integer_ids' (all logical), and 'chunk_size' (numeric, for testing
+ *        only)
+ *
+ * @return ParseOptions to be passed to XmlData or XmlDataSC
+ */
+ParseOptions osm_convert::get_parse_options (const Rcpp::List &opts)
+{
+    ParseOptions res;
+    if (opts.containsElementNamed ("keys"))
+    {
+        std::vector <std::string> keys =
+            Rcpp::as <std::vector <std::string> > (opts ["keys"]);
+        for (auto &k: keys)
+            res.add_key (k);
+    }
+    if (opts.containsElementNamed ("exclude_keys"))
+        res.exclude_keys = Rcpp::as <bool> (opts ["exclude_keys"]);
+    if (opts.containsElementNamed ("poly_x"))
+    {
+        res.poly_x = Rcpp::as <std::vector <double> > (opts ["poly_x"]);
+        res.poly_y = Rcpp::as <std::vector <double> > (opts ["poly_y"]);
+        if (res.poly_x.size () != res.poly_y.size ())
+            throw std::runtime_error ("poly_x and poly_y must have equal sizes");
+    }
+    if (opts.containsElementNamed ("exclude"))
+        res.exclude = Rcpp::as <bool> (opts ["exclude"]);
+    if (opts.containsElementNamed ("compact"))
+        res.compact = Rcpp::as <bool> (opts ["compact"]);
+    if (opts.containsElementNamed ("merge_lines"))
+        res.merge_lines = Rcpp::as <bool> (opts ["merge_lines"]);
+    if (opts.containsElementNamed ("integer_ids"))
+        res.integer_ids = Rcpp::as <bool> (opts ["integer_ids"]);
+    if (opts.containsElementNamed ("chunk_size"))
+        res.chunk_size = Rcpp::as <size_t> (opts ["chunk_size"]);
+    return res;
+}
@@ -24,7 +24,7 @@
  *
  *  Limitations:
  *
- *  Dependencies:       none (rapidXML header included in osmdata)
+ *  Dependencies:       none
  *
  *  Compiler Options:   -std=c++11
  ***************************************************************************/
@@ -37,16 +37,78 @@
 
 namespace osm_convert {
 
+/* R strings (CHARSXPs) for the entries of a Dictionary, each created only
+ * once, when first used. The cached strings are protected by being held in
+ * `m_chars`, and so remain valid for the lifetime of the cache.
+ */
+class StringCache
+{
+    private:
+
+        const Dictionary &m_dict;
+        Rcpp::CharacterVector m_chars;
+        std::vector <bool> m_made;
+
+    public:
+
+        StringCache (const Dictionary &dict)
+            : m_dict (dict), m_chars (dict.size ()),
+              m_made (dict.size (), false) {}
+
+        SEXP get (uint32_t i)
+        {
+            if (!m_made [i])
+            {
+                m_chars [i] = m_dict.str (i);
+                m_made [i] = true;
+            }
+            return m_chars [i];
+        }
+};
+
+/* Key-value pairs of a set of objects held as one R character vector per key,
+ * each initially NA, from which a data.frame is formed directly, without any
+ * intermediate matrix. Columns are indexed as in UniqueVals::k_*_index.
+ */
+class KeyValColumns
+{
+    private:
+
+        Rcpp::List m_cols;
+
+    public:
+
+        KeyValColumns (size_t nrow, size_t ncol)
+            : m_cols (static_cast <R_xlen_t> (ncol))
+        {
+            for (R_xlen_t j = 0; j < m_cols.size (); j++)
+            {
+                Rcpp::CharacterVector col (static_cast <R_xlen_t> (nrow));
+                std::fill (col.begin (), col.end (), NA_STRING);
+                m_cols [j] = col;
+            }
+        }
+
+        void set (size_t row, size_t col, SEXP value)
+        {
+            SET_STRING_ELT (VECTOR_ELT (m_cols, static_cast <R_xlen_t> (col)),
+                    static_cast <R_xlen_t> (row), value);
+        }
+
+        Rcpp::List as_data_frame (const std::vector <std::string> &ids,
+                const std::set <std::string> &keys) const;
+};
+
 void trace_way_nmat (const Ways &ways, const Nodes &nodes, 
         const osmid_t &wayi_id, Rcpp::NumericMatrix &nmat);
 
 void get_value_mat_way (Ways::const_iterator wayi,
-        const UniqueVals &unique_vals, Rcpp::CharacterMatrix &value_arr,
-        unsigned int rowi);
+        const UniqueVals &unique_vals, StringCache &strings,
+        Rcpp::CharacterMatrix &value_arr, unsigned int rowi);
 
 void get_value_mat_rel (Relations::const_iterator &reli,
-        const UniqueVals &unique_vals, Rcpp::CharacterMatrix &value_arr,
-        unsigned int rowi);
+        const UniqueVals &unique_vals, StringCache &strings,
+        Rcpp::CharacterMatrix &value_arr, unsigned int rowi);
 
 Rcpp::CharacterMatrix restructure_kv_mat (Rcpp::CharacterMatrix &kv, bool ls);
 
@@ -56,6 +118,10 @@ template <typename T> Rcpp::List convert_poly_linestring_to_sf (
         const std::vector <std::vector <T> > &id_vec, 
         const std::vector <std::string> &rel_id, const std::string type);
 
+Rcpp::List convert_multipoly_to_sf (const double_arr3 &lon_arr,
+        const double_arr3 &lat_arr, const string_arr3 &rowname_arr,
+        const string_arr2 &id_vec, const std::vector <std::string> &rel_id);
+
 void convert_multipoly_to_sp (Rcpp::S4 &multipolygons, const Relations &rels,
         const double_arr3 &lon_arr, const double_arr3 &lat_arr, 
         const string_arr3 &rowname_arr, const string_arr2 &id_vec,
@@ -70,4 +136,10 @@ void convert_relation_to_sc (string_arr2 &members_out,
         string_arr2 &kv_out, const Relations &rels,
         const UniqueVals &unique_vals);
 
+Rcpp::NumericVector coords_to_Rcpp (const Coords &coords);
+
+Rcpp::CharacterVector convert_meta_to_Rcpp (const OsmMeta &meta);
+
+ParseOptions get_parse_options (const Rcpp::List &opts);
+
 } // end namespace osm_convert
@@ -23,7 +23,7 @@
  *
  *  Limitations:
  *
- *  Dependencies:       none (rapidXML header included in osmdata)
+ *  Dependencies:       none
  *
  *  Compiler Options:   -std=c++11 
  ***************************************************************************/
@@ -0,0 +1,133 @@
+/***************************************************************************
+ *  Project:    osmdata
+ *  File:       mmap-file.cpp
+ *  Language:   C++
+ *
+ *  osmdata is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  osmdata is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along with
+ *  osm-router.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Author:     Mark Padgham
+ *  E-Mail:     mark.padgham@email.com
+ *
+ *  Description:    Read-only memory mapping of input files, so that they can
+ *                  be parsed without first being copied into memory.
+ *
+ *  Limitations:
+ *
+ *  Dependencies:       POSIX mmap or Win32 file mapping
+ *
+ *  Compiler Options:   -std=c++11
+ ***************************************************************************/
+
+#include "mmap-file.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile (const std::string& filename)
+{
+    HANDLE file = CreateFileA (filename.c_str (), GENERIC_READ,
+            FILE_SHARE_READ, NULL, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error ("file " + filename + " can not be opened");
+
+    LARGE_INTEGER fsize;
+    if (!GetFileSizeEx (file, &fsize))
+    {
+        CloseHandle (file);
+        throw std::runtime_error ("size of file " + filename +
+                " can not be determined");
+    }
+    m_file = file;
+    m_size = static_cast <size_t> (fsize.QuadPart);
+    if (m_size == 0) // empty files can not be mapped
+        return;
+
+    HANDLE mapping = CreateFileMappingA (file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL)
+    {
+        CloseHandle (file);
+        throw std::runtime_error ("file " + filename + " can not be mapped");
+    }
+    m_mapping = mapping;
+    m_data = static_cast <const char *> (
+            MapViewOfFile (mapping, FILE_MAP_READ, 0, 0, 0));
+    if (m_data == nullptr)
+    {
+        CloseHandle (mapping);
+        CloseHandle (file);
+        throw std::runtime_error ("file " + filename + " can not be mapped");
+    }
+}
+
+MappedFile::~MappedFile ()
+{
+    if (m_data != nullptr)
+        UnmapViewOfFile (m_data);
+    if (m_mapping != nullptr)
+        CloseHandle (static_cast <HANDLE> (m_mapping));
+    if (m_file != nullptr)
+        CloseHandle (static_cast <HANDLE> (m_file));
+}
+
+#else
+
+MappedFile::MappedFile (const std::string& filename)
+{
+    int fd = open (filename.c_str (), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error ("file " + filename + " can not be opened");
+
+    struct stat st;
+    if (fstat (fd, &st) != 0)
+    {
+        close (fd);
+        throw std::runtime_error ("size of file " + filename +
+                " can not be determined");
+    }
+    m_size = static_cast <size_t> (st.st_size);
+    if (m_size == 0) // empty files can not be mapped
+    {
+        close (fd);
+        return;
+    }
+
+    void * p = mmap (nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping remains valid after the descriptor is closed
+    close (fd);
+    if (p == MAP_FAILED)
+        throw std::runtime_error ("file " + filename + " can not be mapped");
+#ifdef MADV_SEQUENTIAL
+    madvise (p, m_size, MADV_SEQUENTIAL);
+#endif
+    m_data = static_cast <const char *> (p);
+}
+
+MappedFile::~MappedFile ()
+{
+    if (m_data != nullptr)
+        munmap (const_cast <char *> (m_data), m_size);
+}
+
+#endif
@@ -0,0 +1,59 @@
+/***************************************************************************
+ *  Project:    osmdata
+ *  File:       mmap-file.h
+ *  Language:   C++
+ *
+ *  osmdata is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  osmdata is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along with
+ *  osm-router.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Author:     Mark Padgham
+ *  E-Mail:     mark.padgham@email.com
+ *
+ *  Description:    Read-only memory mapping of input files, so that they can
+ *                  be parsed without first being copied into memory.
+ *
+ *  Limitations:
+ *
+ *  Dependencies:       POSIX mmap or Win32 file mapping
+ *
+ *  Compiler Options:   -std=c++11
+ ***************************************************************************/
+
+#pragma once
+
+#include <string>
+
+class MappedFile
+{
+    private:
+
+        const char * m_data = nullptr;
+        size_t m_size = 0;
+#ifdef _WIN32
+        void * m_file = nullptr;
+        void * m_mapping = nullptr;
+#endif
+
+    public:
+
+        MappedFile (const std::string& filename);
+        ~MappedFile ();
+
+        // The mapping can not be shared, so copying is prohibited
+        MappedFile (const MappedFile&) = delete;
+        MappedFile& operator= (const MappedFile&) = delete;
+
+        const char * begin () const { return m_data; }
+        const char * end () const { return m_data + m_size; }
+        size_t size () const { return m_size; }
+};
@@ -0,0 +1,165 @@
+/***************************************************************************
+ *  Project:    osmdata
+ *  File:       osmdata-handle.cpp
+ *  Language:   C++
+ *
+ *  osmdata is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  osmdata is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along with
+ *  osm-router.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Author:     Mark Padgham
+ *  E-Mail:     mark.padgham@email.com
+ *
+ *  Description:    Parse OSM data once into an XmlData object held by R as an
+ *                  external pointer, which may then be converted to any of the
+ *                  sf, sp, or sc formats without being parsed again.
+ *
+ *  Limitations:    External pointers are not preserved when R objects are
+ *                  saved and re-loaded.
+ *
+ *  Dependencies:       none
+ *
+ *  Compiler Options:   -std=c++11
+ ***************************************************************************/
+
+#include "osmdata.h"
+#include "mmap-file.h"
+
+#include <Rcpp.h>
+
+// Retrieve the XmlData object from a handle, which will be null if the handle
+// has been serialized and restored.
+const XmlData& get_handle (SEXP handle)
+{
+    Rcpp::XPtr <XmlData> xml (handle);
+    if (xml.get () == nullptr)
+        throw std::runtime_error ("parsed OSM data are no longer available; "
+                "handles can not be saved and re-loaded");
+    return *xml;
+}
+
+//' rcpp_osmdata_parse
+//'
+//' Parse OSM data into an XmlData object held as an external pointer
+//'
+//' @param st Text contents of an overpass API query
+//' @param opts List of parsing options, as constructed by the R function
+//' `parse_options`
+//' @return External pointer to the parsed data
+//'
+//' @noRd
+// [[Rcpp::export]]
+SEXP rcpp_osmdata_parse (const std::string& st,
+        Rcpp::List opts = Rcpp::List::create ())
+{
+    XmlData * xml = new XmlData (st, osm_convert::get_parse_options (opts));
+    return Rcpp::XPtr <XmlData> (xml, true);
+}
+
+//' rcpp_osmdata_parse_file
+//'
+//' Parse OSM data from a file into an XmlData object held as an external
+//' pointer. The file is memory-mapped and parsed without being copied.
+//'
+//' @param filename Full path to an OSM XML or .osm.pbf file, distinguished
+//' by content rather than name.
+//' @param opts List of parsing options, as constructed by the R function
+//' `parse_options`
+//' @return External pointer to the parsed data
+//'
+//' @noRd
+// [[Rcpp::export]]
+SEXP rcpp_osmdata_parse_file (const std::string& filename,
+        Rcpp::List opts = Rcpp::List::create ())
+{
+    MappedFile f (filename);
+    XmlData * xml = new XmlData (f.begin (), f.end (),
+            pbf::is_pbf (f.begin (), f.end ()),
+            osm_convert::get_parse_options (opts));
+    return Rcpp::XPtr <XmlData> (xml, true);
+}
+
+//' rcpp_osmdata_handle_info
+//'
+//' Summarise parsed OSM data without converting them
+//'
+//' @param handle External pointer returned from `rcpp_osmdata_parse`
+//' @return Rcpp::List of the numbers of nodes, ways, and relations, the bbox
+//' of all nodes, and the header metadata
+//'
+//' @noRd
+// [[Rcpp::export]]
+Rcpp::List rcpp_osmdata_handle_info (SEXP handle)
+{
+    const XmlData &xml = get_handle (handle);
+
+    Rcpp::NumericVector counts = Rcpp::NumericVector::create (
+            Rcpp::Named ("nodes") = static_cast <double> (xml.nodes ().size ()),
+            Rcpp::Named ("ways") = static_cast <double> (xml.ways ().size ()),
+            Rcpp::Named ("relations") =
+                static_cast <double> (xml.relations ().size ()));
+
+    Rcpp::NumericVector bbox = rcpp_get_bbox_sf (xml.x_min (), xml.y_min (),
+            xml.x_max (), xml.y_max ());
+
+    return Rcpp::List::create (
+            Rcpp::Named ("counts") = counts,
+            Rcpp::Named ("bbox") = bbox,
+            Rcpp::Named ("meta") =
+                osm_convert::convert_meta_to_Rcpp (xml.meta ()));
+}
+
+//' rcpp_osmdata_handle_sf
+//'
+//' Return previously parsed OSM data in Simple Features format
+//'
+//' @param handle External pointer returned from `rcpp_osmdata_parse`
+//' @return Rcpp::List objects of OSM data, as for `rcpp_osmdata_sf`
+//'
+//' @noRd
+// [[Rcpp::export]]
+Rcpp::List rcpp_osmdata_handle_sf (SEXP handle)
+{
+    return osm_sf::get_osmdata (get_handle (handle));
+}
+
+//' rcpp_osmdata_handle_sp
+//'
+//' Return previously parsed OSM data in sp format
+//'
+//' @param handle External pointer returned from `rcpp_osmdata_parse`
+//' @return Rcpp::List objects of OSM data, as for `rcpp_osmdata_sp`
+//'
+//' @noRd
+// [[Rcpp::export]]
+Rcpp::List rcpp_osmdata_handle_sp (SEXP handle)
+{
+    return osm_sp::get_osmdata (get_handle (handle));
+}
+
+//' rcpp_osmdata_handle_sc
+//'
+//' Return previously parsed OSM data in silicate (SC) format
+//'
+//' @param handle External pointer returned from `rcpp_osmdata_parse`
+//' @param integer_ids If `TRUE`, return identifiers as numeric rather than
+//' character values
+//' @return Rcpp::List objects of OSM data, as for `rcpp_osmdata_sc`
+//'
+//' @noRd
+// [[Rcpp::export]]
+Rcpp::List rcpp_osmdata_handle_sc (SEXP handle, const bool integer_ids = false)
+{
+    if (integer_ids)
+        return osm_sc::get_osmdata <osmid_t> (get_handle (handle));
+    return osm_sc::get_osmdata <std::string> (get_handle (handle));
+}
@@ -24,139 +24,112 @@
  *
  *  Limitations:
  *
- *  Dependencies:       none (rapidXML header included in osmdata)
+ *  Dependencies:       none
  *
  *  Compiler Options:   -std=c++11
  ***************************************************************************/
 
 #include "osmdata.h"
 #include "osmdata-sc.h"
+#include "mmap-file.h"
 
-// Function to generate IDs for the edges in each way
-std::string random_id (size_t len) {
-    auto randchar = []() -> char
-    {
-        const char charset[] = \
-            "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
-        const size_t max_index = (sizeof(charset) - 1);
-        //return charset [ rand() % max_index ];
-        size_t i = static_cast <size_t> (floor (Rcpp::runif (1) [0] * max_index));
-        return charset [i];
-    };
-    std::string str (len, 0);
-    std::generate_n (str.begin(), len, randchar);
-    return str;
-}
-
-Rcpp::List rel_membs_as_list (XmlDataSC &xml)
-{
-    std::unordered_map <std::string, std::vector <std::string> >
-        rel_membs = xml.get_rel_membs ();
-
-    Rcpp::List ret (rel_membs.size ());
-    std::vector <std::string> retnames (rel_membs.size ());
-
-    size_t i1 = 0; // std::vector index is size_t
-    int i2 = 0; // Rcpp index is int
-    for (auto m: rel_membs)
-    {
-        retnames [i1++] = m.first;
-        ret [i2++] = m.second;
-    }
-    ret.attr ("names") = retnames;
-
-    return ret;
-}
-
-Rcpp::List way_membs_as_list (XmlDataSC &xml)
+/* membs_as_list
+ *
+ * Split the members of ways or relations into a list named by their ids, in the
+ * order in which they were read. Each list item is copied as a single range.
+ */
+template <typename Id>
+Rcpp::List membs_as_list (const MemberLists <Id> &membs)
 {
-    std::unordered_map <std::string, std::vector <std::string> >
-        way_membs = xml.get_way_membs ();
+    const size_t n = membs.size ();
+    Rcpp::List ret (n);
+    std::vector <std::string> retnames (n);
 
-    Rcpp::List ret (way_membs.size ());
-    std::vector <std::string> retnames (way_membs.size ());
-
-    size_t i1 = 0;
-    int i2 = 0;
-    for (auto m: way_membs)
+    for (size_t i = 0; i < n; i++)
     {
-        retnames [i1] = m.first;
-        ret [i2++] = m.second;
+        retnames [i] = SCId <Id>::str (membs.id (i));
+        ret [static_cast <int> (i)] = SCId <Id>::to_R (membs.begin (i),
+                membs.end (i));
     }
     ret.attr ("names") = retnames;
 
     return ret;
 }
 
-//' rcpp_osmdata_sc
+//' get_osmdata
 //'
-//' Return OSM data in silicate (SC) format
+//' Convert the contents of an XmlDataSC object to silicate (SC) format
 //'
-//' @param st Text contents of an overpass API query
+//' @param xml Pointer to the parsed XmlDataSC object
 //' @return Rcpp::List objects of OSM data
 //' 
 //' @noRd 
-// [[Rcpp::export]]
-Rcpp::List rcpp_osmdata_sc (const std::string& st)
+template <typename Id>
+Rcpp::List osm_sc::get_osmdata (const XmlDataSC <Id> &xml)
 {
-#ifdef DUMP_INPUT
-    {
-        std::ofstream dump ("./osmdata-sf.xml");
-        if (dump.is_open())
-        {
-            dump.write (st.c_str(), st.size());
-        }
-    }
-#endif
-
-    XmlDataSC xml (st);
-
     Rcpp::DataFrame vertex = Rcpp::DataFrame::create (
-            Rcpp::Named ("x_") = xml.get_vx (),
-            Rcpp::Named ("y_") = xml.get_vy (),
-            Rcpp::Named ("vertex_") = xml.get_vert_id (),
+            Rcpp::Named ("x_") = osm_convert::coords_to_Rcpp (xml.get_vx ()),
+            Rcpp::Named ("y_") = osm_convert::coords_to_Rcpp (xml.get_vy ()),
+            Rcpp::Named ("vertex_") = SCId <Id>::to_R (xml.get_vert_id ()),
             Rcpp::_["stringsAsFactors"] = false );
 
+    Rcpp::RObject edge_id = SCId <Id>::to_R (xml.get_edge ());
     Rcpp::DataFrame edge = Rcpp::DataFrame::create (
-            Rcpp::Named (".vx0") = xml.get_vx0 (),
-            Rcpp::Named (".vx1") = xml.get_vx1 (),
-            Rcpp::Named ("edge_") = xml.get_edge (),
+            Rcpp::Named (".vx0") = SCId <Id>::to_R (xml.get_vx0 ()),
+            Rcpp::Named (".vx1") = SCId <Id>::to_R (xml.get_vx1 ()),
+            Rcpp::Named ("edge_") = edge_id,
             Rcpp::_["stringsAsFactors"] = false );
 
     Rcpp::DataFrame oXe = Rcpp::DataFrame::create (
-            Rcpp::Named ("edge_") = xml.get_edge (),
-            Rcpp::Named ("object_") = xml.get_object (),
+            Rcpp::Named ("edge_") = edge_id,
+            Rcpp::Named ("object_") = SCId <Id>::to_R (xml.get_object ()),
             Rcpp::_["stringsAsFactors"] = false );
 
     Rcpp::DataFrame obj_node = Rcpp::DataFrame::create (
-            Rcpp::Named ("vertex_") = xml.get_node_id (),
+            Rcpp::Named ("vertex_") = SCId <Id>::to_R (xml.get_node_id ()),
             Rcpp::Named ("key") = xml.get_node_key (),
             Rcpp::Named ("value") = xml.get_node_val (),
             Rcpp::_["stringsAsFactors"] = false );
 
     Rcpp::DataFrame obj_way = Rcpp::DataFrame::create (
-            Rcpp::Named ("object_") = xml.get_way_id (),
+            Rcpp::Named ("object_") = SCId <Id>::to_R (xml.get_way_id ()),
             Rcpp::Named ("key") = xml.get_way_key (),
             Rcpp::Named ("value") = xml.get_way_val (),
             Rcpp::_["stringsAsFactors"] = false );
 
     Rcpp::DataFrame obj_rel_memb = Rcpp::DataFrame::create (
-            Rcpp::Named ("relation_") = xml.get_rel_memb_id (),
-            Rcpp::Named ("member") = xml.get_rel_ref (),
+            Rcpp::Named ("relation_") = SCId <Id>::to_R (xml.get_rel_memb_id ()),
+            Rcpp::Named ("member") = SCId <Id>::to_R (xml.get_rel_ref ()),
             Rcpp::Named ("type") = xml.get_rel_memb_type (),
             Rcpp::Named ("role") = xml.get_rel_role (),
             Rcpp::_["stringsAsFactors"] = false );
 
     Rcpp::DataFrame obj_rel_kv = Rcpp::DataFrame::create (
-            Rcpp::Named ("relation_") = xml.get_rel_kv_id (),
+            Rcpp::Named ("relation_") = SCId <Id>::to_R (xml.get_rel_kv_id ()),
             Rcpp::Named ("key") = xml.get_rel_key (),
             Rcpp::Named ("value") = xml.get_rel_val (),
             Rcpp::_["stringsAsFactors"] = false );
 
-    Rcpp::List rel_membs = rel_membs_as_list (xml),
-        way_membs = way_membs_as_list (xml);
+    Rcpp::List rel_membs = membs_as_list (xml.get_rel_membs ()),
+        way_membs = membs_as_list (xml.get_way_membs ());
+
+    return osm_sc::collate_sc (vertex, edge, oXe, obj_node, obj_way,
+            obj_rel_memb, obj_rel_kv, way_membs, rel_membs,
+            osm_convert::convert_meta_to_Rcpp (xml.meta ()));
+}
 
-    Rcpp::List ret (9);
+/* collate_sc
+ *
+ * Collate the component tables of an SC object into the list returned to R
+ */
+Rcpp::List osm_sc::collate_sc (const Rcpp::DataFrame &vertex,
+        const Rcpp::DataFrame &edge, const Rcpp::DataFrame &oXe,
+        const Rcpp::DataFrame &obj_node, const Rcpp::DataFrame &obj_way,
+        const Rcpp::DataFrame &obj_rel_memb, const Rcpp::DataFrame &obj_rel_kv,
+        const Rcpp::List &way_membs, const Rcpp::List &rel_membs,
+        const Rcpp::CharacterVector &meta)
+{
+    Rcpp::List ret (10);
     ret [0] = vertex;
     ret [1] = edge;
     ret [2] = oXe;
@@ -164,16 +137,325 @@ Rcpp::List rcpp_osmdata_sc (const std::string& st)
     ret [4] = obj_way; // The SC object table
     ret [5] = obj_rel_memb;
     ret [6] = obj_rel_kv;
-    ret [7] = Rcpp::as <Rcpp::List> (way_membs);
-    ret [8] = Rcpp::as <Rcpp::List> (rel_membs);
+    ret [7] = way_membs;
+    ret [8] = rel_membs;
+    ret [9] = meta;
 
     std::vector <std::string> retnames {"vertex", 
                                         "edge", "object_link_edge",
                                         "nodes", "object",
                                         "relation_members",
                                         "relation_properties",
-                                        "way_membs", "rel_membs"};
+                                        "way_membs", "rel_membs",
+                                        "meta"};
     ret.attr ("names") = retnames;
     
     return ret;
 }
+
+/************************************************************************
+ ************************************************************************
+ **                                                                    **
+ **                  SC CONVERSION OF PARSED XMLDATA                   **
+ **                                                                    **
+ ************************************************************************
+ ************************************************************************
+ *
+ * These functions convert an already-parsed XmlData object into SC format,
+ * so that one parse can be converted to any format. Rows follow the order of
+ * the XmlData object, and so are ordered by OSM id for nodes and ways. The
+ * members of each relation are ordered as nodes, ways, then relations.
+ *
+ * With a bounding polygon, hidden nodes and ways are only parts of the
+ * geometries of other objects, as for the sf and sp converters. Their
+ * vertices and edges are retained, but they have no rows in the kv tables.
+ */
+
+template <typename Id>
+void osm_sc::get_osm_nodes (Rcpp::DataFrame &node_df, Rcpp::DataFrame &kv_df,
+        const XmlData &xml)
+{
+    const Nodes &nodes = xml.nodes ();
+    const Dictionary &dict = xml.unique_vals ().strings;
+    const size_t n = nodes.size ();
+
+    // Hidden nodes are vertices only where edges still reference them
+    std::vector <bool> in_edge;
+    if (!xml.hidden_nodes ().empty ())
+    {
+        in_edge.assign (n, false);
+        for (auto &w: xml.ways ())
+            if (w.second.nodes.size () > 1)
+                for (auto j: w.second.node_index)
+                    if (j != MISSING_NODE)
+                        in_edge [j] = true;
+    }
+
+    std::vector <double> vx, vy;
+    std::vector <Id> vert_id;
+    vx.reserve (n);
+    vy.reserve (n);
+    vert_id.reserve (n);
+    std::vector <Id> kv_id;
+    std::vector <std::string> key, val;
+    for (size_t i = 0; i < n; i++)
+    {
+        const bool hidden = xml.is_hidden_node (i);
+        if (hidden && !in_edge [i])
+            continue;
+        const Id id = SCId <Id>::from (nodes.id (i));
+        vx.push_back (nodes.lon (i));
+        vy.push_back (nodes.lat (i));
+        vert_id.push_back (id);
+        if (hidden)
+            continue;
+        for (size_t j = nodes.kv_begin (i); j < nodes.kv_end (i); j++)
+        {
+            kv_id.push_back (id);
+            key.push_back (dict.str (nodes.key (j)));
+            val.push_back (dict.str (nodes.value (j)));
+        }
+    }
+
+    node_df = Rcpp::DataFrame::create (
+            Rcpp::Named ("x_") = vx,
+            Rcpp::Named ("y_") = vy,
+            Rcpp::Named ("vertex_") = SCId <Id>::to_R (vert_id),
+            Rcpp::_["stringsAsFactors"] = false );
+
+    kv_df = Rcpp::DataFrame::create (
+            Rcpp::Named ("vertex_") = SCId <Id>::to_R (kv_id),
+            Rcpp::Named ("key") = key,
+            Rcpp::Named ("value") = val,
+            Rcpp::_["stringsAsFactors"] = false );
+}
+
+template <typename Id>
+void osm_sc::get_osm_ways (Rcpp::DataFrame &edge,
+        Rcpp::DataFrame &object_link_edge, Rcpp::DataFrame &kv_df,
+        const XmlData &xml)
+{
+    const Dictionary &dict = xml.unique_vals ().strings;
+    std::vector <Id> vx0, vx1, edge_id, object;
+    std::vector <Id> kv_id;
+    std::vector <std::string> key, val;
+    for (auto &wi: xml.ways ())
+    {
+        const Id id = SCId <Id>::from (wi.first);
+        const ArenaVector <osmid_t> &wnodes = wi.second.nodes;
+        for (size_t i = 1; i < wnodes.size (); i++)
+        {
+            vx0.push_back (SCId <Id>::from (wnodes [i - 1]));
+            vx1.push_back (SCId <Id>::from (wnodes [i]));
+            edge_id.push_back (SCId <Id>::edge (id, i));
+            object.push_back (id);
+        }
+        if (xml.is_hidden_way (wi.first))
+            continue;
+        for (auto &kv: wi.second.key_val)
+        {
+            kv_id.push_back (id);
+            key.push_back (dict.str (kv.first));
+            val.push_back (dict.str (kv.second));
+        }
+    }
+
+    Rcpp::RObject edge_r = SCId <Id>::to_R (edge_id);
+    edge = Rcpp::DataFrame::create (
+            Rcpp::Named (".vx0") = SCId <Id>::to_R (vx0),
+            Rcpp::Named (".vx1") = SCId <Id>::to_R (vx1),
+            Rcpp::Named ("edge_") = edge_r,
+            Rcpp::_["stringsAsFactors"] = false );
+
+    object_link_edge = Rcpp::DataFrame::create (
+            Rcpp::Named ("edge_") = edge_r,
+            Rcpp::Named ("object_") = SCId <Id>::to_R (object),
+            Rcpp::_["stringsAsFactors"] = false );
+
+    kv_df = Rcpp::DataFrame::create (
+            Rcpp::Named ("object_") = SCId <Id>::to_R (kv_id),
+            Rcpp::Named ("key") = key,
+            Rcpp::Named ("value") = val,
+            Rcpp::_["stringsAsFactors"] = false );
+}
+
+template <typename Id>
+void osm_sc::get_osm_relations (Rcpp::DataFrame &rel_df,
+        Rcpp::DataFrame &kv_df, const Relations &rels, const Dictionary &dict)
+{
+    std::vector <Id> memb_id, ref, kv_id;
+    std::vector <std::string> type, role, key, val;
+    for (auto &r: rels)
+    {
+        const Id id = SCId <Id>::from (r.id);
+        const std::vector <std::pair <const RelMembers *, std::string> >
+            members {{&r.nodes, "node"}, {&r.ways, "way"},
+                {&r.relations, "relation"}};
+        for (auto &m: members)
+            for (auto &mi: *m.first)
+            {
+                memb_id.push_back (id);
+                ref.push_back (SCId <Id>::from (mi.first));
+                type.push_back (m.second);
+                role.push_back (mi.second);
+            }
+        for (auto &kv: r.key_val)
+        {
+            kv_id.push_back (id);
+            key.push_back (dict.str (kv.first));
+            val.push_back (dict.str (kv.second));
+        }
+    }
+
+    rel_df = Rcpp::DataFrame::create (
+            Rcpp::Named ("relation_") = SCId <Id>::to_R (memb_id),
+            Rcpp::Named ("member") = SCId <Id>::to_R (ref),
+            Rcpp::Named ("type") = type,
+            Rcpp::Named ("role") = role,
+            Rcpp::_["stringsAsFactors"] = false );
+
+    kv_df = Rcpp::DataFrame::create (
+            Rcpp::Named ("relation_") = SCId <Id>::to_R (kv_id),
+            Rcpp::Named ("key") = key,
+            Rcpp::Named ("value") = val,
+            Rcpp::_["stringsAsFactors"] = false );
+}
+
+//' get_osmdata
+//'
+//' Convert the contents of an XmlData object to silicate (SC) format
+//'
+//' @param xml Pointer to the parsed XmlData object
+//' @return Rcpp::List objects of OSM data
+//' 
+//' @noRd 
+template <typename Id>
+Rcpp::List osm_sc::get_osmdata (const XmlData &xml)
+{
+    const Dictionary &dict = xml.unique_vals ().strings;
+
+    Rcpp::DataFrame vertex, obj_node;
+    osm_sc::get_osm_nodes <Id> (vertex, obj_node, xml);
+
+    Rcpp::DataFrame edge, oXe, obj_way;
+    osm_sc::get_osm_ways <Id> (edge, oXe, obj_way, xml);
+
+    Rcpp::DataFrame obj_rel_memb, obj_rel_kv;
+    osm_sc::get_osm_relations <Id> (obj_rel_memb, obj_rel_kv, xml.relations (),
+            dict);
+
+    const Ways &ways = xml.ways ();
+    MemberLists <Id> way_lists;
+    way_lists.reserve (ways.size ());
+    for (auto &wi: ways)
+    {
+        way_lists.open (SCId <Id>::from (wi.first));
+        for (auto n: wi.second.nodes)
+            way_lists.push_back (SCId <Id>::from (n));
+    }
+
+    const Relations &rels = xml.relations ();
+    MemberLists <Id> rel_lists;
+    rel_lists.reserve (rels.size ());
+    for (auto &r: rels)
+    {
+        rel_lists.open (SCId <Id>::from (r.id));
+        for (auto &m: r.nodes)
+            rel_lists.push_back (SCId <Id>::from (m.first));
+        for (auto &m: r.ways)
+            rel_lists.push_back (SCId <Id>::from (m.first));
+        for (auto &m: r.relations)
+            rel_lists.push_back (SCId <Id>::from (m.first));
+    }
+
+    Rcpp::List way_membs = membs_as_list (way_lists),
+        rel_membs = membs_as_list (rel_lists);
+
+    return osm_sc::collate_sc (vertex, edge, oXe, obj_node, obj_way,
+            obj_rel_memb, obj_rel_kv, way_membs, rel_membs,
+            osm_convert::convert_meta_to_Rcpp (xml.meta ()));
+}
+
+template Rcpp::List osm_sc::get_osmdata <std::string> (const XmlData &xml);
+template Rcpp::List osm_sc::get_osmdata <osmid_t> (const XmlData &xml);
+
+namespace {
+
+/* XmlDataSC streams XML straight into SC tables, and so can neither decode
+ * PBF blocks nor trim to a bounding polygon, which requires all data to be
+ * read first. Such parses go through XmlData instead. */
+bool needs_xml_data (bool pbf, const ParseOptions &opts)
+{
+    return pbf || opts.has_poly ();
+}
+
+Rcpp::List sc_from_xml_data (const char * begin, const char * end, bool pbf,
+        const ParseOptions &opts)
+{
+    XmlData xml (begin, end, pbf, opts);
+    if (opts.integer_ids)
+        return osm_sc::get_osmdata <osmid_t> (xml);
+    return osm_sc::get_osmdata <std::string> (xml);
+}
+
+} // end anonymous namespace
+
+//' rcpp_osmdata_sc
+//'
+//' Return OSM data in silicate (SC) format
+//'
+//' @param st Text contents of an overpass API query
+//' @param opts List of parsing options, as constructed by the R function
+//' `parse_options`
+//' @return Rcpp::List objects of OSM data
+//' 
+//' @noRd 
+// [[Rcpp::export]]
+Rcpp::List rcpp_osmdata_sc (const std::string& st,
+        Rcpp::List opts = Rcpp::List::create ())
+{
+#ifdef DUMP_INPUT
+    {
+        std::ofstream dump ("./osmdata-sf.xml");
+        if (dump.is_open())
+        {
+            dump.write (st.c_str(), st.size());
+        }
+    }
+#endif
+
+    const ParseOptions parse_opts = osm_convert::get_parse_options (opts);
+    if (needs_xml_data (false, parse_opts))
+        return sc_from_xml_data (st.c_str (), st.c_str () + st.size (), false,
+                parse_opts);
+    if (parse_opts.integer_ids)
+        return osm_sc::get_osmdata (XmlDataSC <osmid_t> (st, parse_opts));
+    return osm_sc::get_osmdata (XmlDataSC <std::string> (st, parse_opts));
+}
+
+//' rcpp_osmdata_sc_file
+//'
+//' Return OSM data from a file in silicate (SC) format. The file is
+//' memory-mapped and parsed without being copied.
+//'
+//' @param filename Full path to an OSM XML or PBF file
+//' @param opts List of parsing options, as constructed by the R function
+//' `parse_options`
+//' @return Rcpp::List objects of OSM data
+//' 
+//' @noRd 
+// [[Rcpp::export]]
+Rcpp::List rcpp_osmdata_sc_file (const std::string& filename,
+        Rcpp::List opts = Rcpp::List::create ())
+{
+    MappedFile f (filename);
+    const ParseOptions parse_opts = osm_convert::get_parse_options (opts);
+    const bool pbf = pbf::is_pbf (f.begin (), f.end ());
+    if (needs_xml_data (pbf, parse_opts))
+        return sc_from_xml_data (f.begin (), f.end (), pbf, parse_opts);
+    if (parse_opts.integer_ids)
+        return osm_sc::get_osmdata (XmlDataSC <osmid_t> (f.begin (), f.end (),
+                    parse_opts));
+    return osm_sc::get_osmdata (XmlDataSC <std::string> (f.begin (), f.end (),
+                parse_opts));
+}
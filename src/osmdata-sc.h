@@ -23,7 +23,7 @@
  *
  *  Limitations:
  *
- *  Dependencies:       none (rapidXML header included in osmdata)
+ *  Dependencies:       none
  *
  *  Compiler Options:   -std=c++11
  ***************************************************************************/
@@ -33,11 +33,117 @@
 #include <Rcpp.h>
 
 #include "common.h"
+#include "xml-stream.h"
 #include "get-bbox.h"
 #include "trace-osm.h"
 #include "convert-osm-rcpp.h"
 
-std::string random_id (size_t len);
+/* Identifiers of vertices, edges, and objects in SC tables are held either as
+ * strings, or as 64-bit integers which are returned to R as doubles (exact for
+ * all OSM ids), so that the tables may be joined on numeric columns. SCId
+ * reads, forms, and converts identifiers of either type. */
+template <typename Id> struct SCId;
+
+template <> struct SCId <std::string>
+{
+    static std::string read (const xml_stream::Attr &a) { return a.str (); }
+    static std::string from (osmid_t id) { return std::to_string (id); }
+    static std::string str (const std::string &id) { return id; }
+
+    // Identifier of the edge joining nodes (i - 1) and i of a way, which is
+    // unique and the same whichever way the data are parsed
+    static std::string edge (const std::string &way_id, size_t i)
+    {
+        return way_id + "-" + std::to_string (i);
+    }
+
+    static Rcpp::CharacterVector to_R (const std::vector <std::string> &ids)
+    {
+        return Rcpp::wrap (ids);
+    }
+
+    template <typename It>
+    static Rcpp::CharacterVector to_R (It first, It last)
+    {
+        return Rcpp::CharacterVector (first, last);
+    }
+};
+
+template <> struct SCId <osmid_t>
+{
+    // Bits of integer edge ids holding the position of an edge within its way
+    static constexpr int EDGE_BITS = 16;
+
+    static osmid_t read (const xml_stream::Attr &a) { return a.to_integer (); }
+    static osmid_t from (osmid_t id) { return id; }
+    static std::string str (osmid_t id) { return std::to_string (id); }
+
+    // As for strings, but with the position of the edge in the low bits, so
+    // ids remain exact as doubles for way ids up to 2^37
+    static osmid_t edge (osmid_t way_id, size_t i)
+    {
+        const osmid_t limit = 1LL << (53 - EDGE_BITS);
+        if (i >= (1u << EDGE_BITS) || way_id >= limit || way_id <= -limit)
+            throw std::runtime_error ("way " + std::to_string (way_id) +
+                    " can not be given integer edge ids");
+        return way_id * (1LL << EDGE_BITS) + static_cast <osmid_t> (i);
+    }
+
+    static Rcpp::NumericVector to_R (const std::vector <osmid_t> &ids)
+    {
+        return Rcpp::NumericVector (ids.begin (), ids.end ());
+    }
+
+    template <typename It>
+    static Rcpp::NumericVector to_R (It first, It last)
+    {
+        return Rcpp::NumericVector (first, last);
+    }
+};
+
+/* The members of all ways or relations, in compressed sparse row form: the
+ * members of list i are members [offset [i]] to members [offset [i + 1] - 1],
+ * and lists are held in the order they are opened. */
+template <typename Id>
+class MemberLists
+{
+    private:
+        std::vector <Id> m_id;
+        std::vector <size_t> m_offset {0};
+        std::vector <Id> m_members;
+
+    public:
+        // Start a new list, to which all subsequent members are added
+        void open (const Id &id)
+        {
+            m_id.push_back (id);
+            m_offset.push_back (m_members.size ());
+        }
+
+        void push_back (const Id &member)
+        {
+            m_members.push_back (member);
+            m_offset.back ()++;
+        }
+
+        void reserve (size_t n_lists)
+        {
+            m_id.reserve (n_lists);
+            m_offset.reserve (n_lists + 1);
+        }
+
+        size_t size () const { return m_id.size (); }
+        const Id& id (size_t i) const { return m_id [i]; }
+
+        typename std::vector <Id>::const_iterator begin (size_t i) const
+        {
+            return m_members.begin () + m_offset [i];
+        }
+        typename std::vector <Id>::const_iterator end (size_t i) const
+        {
+            return m_members.begin () + m_offset [i + 1];
+        }
+};
 
 /************************************************************************
  ************************************************************************
@@ -48,6 +154,7 @@ std::string random_id (size_t len);
  ************************************************************************/
 
 
+template <typename Id>
 class XmlDataSC
 {
     /* Two main options to efficiently store-on-reading are:
@@ -55,67 +162,77 @@ class XmlDataSC
      * copying all entries over to an appropriate Rcpp::Matrix class; or
      * 2. Setting up individual vectors for each (id, key, val), and just
      * Rcpp::wrap-ing them for return.
-     * The second is more efficient, and so is implemented here, via an initial
-     * read to determine the sizes of the vectors (in Counters), then a second
-     * read to store them.
+     * The second is more efficient, and so is implemented here. The vectors
+     * are columns of the eventual tables, which are appended to while
+     * streaming once over the raw XML buffer, so no DOM is constructed, and
+     * nothing need be counted in advance.
      */
 
     public:
 
-        struct Counters {
-            // Initial function getSizes does an initial scan of the XML doc and
-            // establishes the sizes of everything with these counters
-            size_t nnodes, nnode_kv,
-                nways, nway_kv, nedges,
-                nrels, nrel_kv, nrel_memb;
-            std::string id;
-        };
-
         struct Vectors {
-            // Vectors used to store the data, with sizes allocated according to
-            // the values of Counters
+            // Columns of the output tables, each of which grows as elements
+            // are read
             //
             // vectors for key-val pairs in object table:
+            std::vector <Id> rel_kv_id, rel_memb_id, rel_ref, way_id, node_id;
             std::vector <std::string>
-                rel_kv_id, rel_key, rel_val,
-                rel_memb_id, rel_memb_type, rel_ref, rel_role,
-                way_id, way_key, way_val,
-                node_id, node_key, node_val;
+                rel_key, rel_val,
+                rel_memb_type, rel_role,
+                way_key, way_val,
+                node_key, node_val;
 
             // vectors for edge and object_link_edge tables:
-            std::vector <std::string> vx0, vx1, edge, object;
+            std::vector <Id> vx0, vx1, edge, object;
             // vectors for vertex table
-            std::vector <double> vx, vy;
-            std::vector <std::string> vert_id;
+            Coords vx, vy;
+            std::vector <Id> vert_id;
         };
 
-        struct Maps {
-            std::unordered_map <std::string, std::vector <std::string> >
-                rel_membs, way_membs;
+        struct Lists {
+            MemberLists <Id> rel_membs, way_membs;
         };
 
     private:
 
-        Counters counters;
         Vectors vectors;
-        Maps maps;
-
-        // Number of nodes in each way, and ways in each rel
-        std::unordered_map <std::string, size_t> waySizes, relSizes;
+        Lists lists;
+        OsmMeta m_meta;
+        ParseOptions m_opts;
+
+        // State of the streaming parse, as for XmlData
+        enum class Element { none, node, way, relation };
+        struct ParseState {
+            Element current = Element::none;
+            size_t depth = 0; // nesting depth within current element
+            Id id; // of current way or relation
+            Id last_ref; // previous node of current way
+            size_t memb_num = 0; // number of members of current way
+        } m_state;
+
+        friend class xml_stream::Parser <XmlDataSC>;
 
     public:
 
-        XmlDataSC (const std::string& str)
+        XmlDataSC (const std::string& str,
+                const ParseOptions &opts = ParseOptions ())
+            : XmlDataSC (str.c_str (), str.c_str () + str.size (), opts) {}
+
+        // Parse directly from any contiguous buffer, such as a MappedFile
+        XmlDataSC (const char * begin, const char * end,
+                const ParseOptions &opts = ParseOptions ())
+            : m_opts (opts)
         {
-            // APS empty m_nodes/m_ways/m_relations constructed here, no need to explicitly clear
-            XmlDocPtr p = parseXML (str);
+            // Parses with bounding polygons go through XmlData instead
+            if (m_opts.has_poly ())
+                throw std::runtime_error (
+                        "bounding polygons can not be applied by XmlDataSC");
 
-            zeroCounters ();
-            getSizes (p->first_node ());
-            vectorsResize ();
+            vectors.vx.set_compact (m_opts.compact);
+            vectors.vy.set_compact (m_opts.compact);
 
-            zeroCounters ();
-            traverseWays (p->first_node ());
+            xml_stream::Parser <XmlDataSC> parser (*this);
+            parser.parse (begin, end);
         }
 
         // APS make the dtor virtual since compiler support for "final" is limited
@@ -123,271 +240,117 @@ class XmlDataSC
         {
         }
 
-        const std::vector <std::string>& get_rel_kv_id() const { return vectors.rel_kv_id;  }
+        const std::vector <Id>& get_rel_kv_id() const { return vectors.rel_kv_id;  }
         const std::vector <std::string>& get_rel_key() const { return vectors.rel_key;  }
         const std::vector <std::string>& get_rel_val() const { return vectors.rel_val;  }
 
-        const std::vector <std::string>& get_rel_memb_id() const { return vectors.rel_memb_id;  }
+        const std::vector <Id>& get_rel_memb_id() const { return vectors.rel_memb_id;  }
         const std::vector <std::string>& get_rel_memb_type() const { return vectors.rel_memb_type;  }
-        const std::vector <std::string>& get_rel_ref() const { return vectors.rel_ref;  }
+        const std::vector <Id>& get_rel_ref() const { return vectors.rel_ref;  }
         const std::vector <std::string>& get_rel_role() const { return vectors.rel_role;  }
 
-        const std::vector <std::string>& get_way_id() const { return vectors.way_id;  }
+        const std::vector <Id>& get_way_id() const { return vectors.way_id;  }
         const std::vector <std::string>& get_way_key() const { return vectors.way_key;  }
         const std::vector <std::string>& get_way_val() const { return vectors.way_val;  }
 
-        const std::vector <std::string>& get_node_id() const { return vectors.node_id;  }
+        const std::vector <Id>& get_node_id() const { return vectors.node_id;  }
         const std::vector <std::string>& get_node_key() const { return vectors.node_key;  }
         const std::vector <std::string>& get_node_val() const { return vectors.node_val;  }
 
         // vectors for edge and object_link_edge tables:
-        const std::vector <std::string>& get_vx0 () const { return vectors.vx0;  }
-        const std::vector <std::string>& get_vx1 () const { return vectors.vx1;  }
-        const std::vector <std::string>& get_edge () const { return vectors.edge;  }
-        const std::vector <std::string>& get_object () const { return vectors.object;  }
+        const std::vector <Id>& get_vx0 () const { return vectors.vx0;  }
+        const std::vector <Id>& get_vx1 () const { return vectors.vx1;  }
+        const std::vector <Id>& get_edge () const { return vectors.edge;  }
+        const std::vector <Id>& get_object () const { return vectors.object;  }
 
         // vectors for vertex table
-        const std::vector <std::string>& get_vert_id () const { return vectors.vert_id;  }
-        const std::vector <double>& get_vx () const { return vectors.vx;  }
-        const std::vector <double>& get_vy () const { return vectors.vy;  }
+        const std::vector <Id>& get_vert_id () const { return vectors.vert_id;  }
+        const Coords& get_vx () const { return vectors.vx;  }
+        const Coords& get_vy () const { return vectors.vy;  }
 
-        const std::unordered_map <std::string, std::vector <std::string> >&
-            get_rel_membs () const { return maps.rel_membs; }
-        const std::unordered_map <std::string, std::vector <std::string> >&
-            get_way_membs () const { return maps.way_membs; }
+        const MemberLists <Id>& get_rel_membs () const { return lists.rel_membs; }
+        const MemberLists <Id>& get_way_membs () const { return lists.way_membs; }
 
-    private:
-
-        void zeroCounters ();
-        void getSizes (XmlNodePtr pt);
-        void vectorsResize ();
+        const OsmMeta& meta () const { return m_meta; }
 
-        void countRelation (XmlNodePtr pt);
-        void countWay (XmlNodePtr pt);
-        void countNode (XmlNodePtr pt);
+    private:
 
-        void traverseWays (XmlNodePtr pt); // The primary function
+        // Callbacks for xml_stream::Parser
+        void start_element (const char * name, size_t len,
+                const xml_stream::Attrs &attrs);
+        void end_element (const char * name, size_t len);
 
-        void traverseRelation (XmlNodePtr pt, size_t &memb_num);
-        void traverseWay (XmlNodePtr pt, size_t& node_num);
-        void traverseNode (XmlNodePtr pt);
+        void traverseRelation (const xml_stream::Attrs &attrs);
+        void traverseWay (const xml_stream::Attrs &attrs);
+        void traverseNode (const xml_stream::Attrs &attrs);
 
 }; // end Class::XmlDataSC
 
-inline void XmlDataSC::zeroCounters ()
-{
-    counters.nnodes = 0;
-    counters.nnode_kv = 0;
-
-    counters.nways = 0;
-    counters.nway_kv = 0;
-    counters.nedges = 0;
-
-    counters.nrels = 0;
-    counters.nrel_kv = 0;
-    counters.nrel_memb = 0;
-}
-
-inline void XmlDataSC::vectorsResize ()
-{
-    vectors.rel_kv_id.resize (counters.nrel_kv);
-    vectors.rel_key.resize (counters.nrel_kv);
-    vectors.rel_val.resize (counters.nrel_kv);
-
-    vectors.rel_memb_id.resize (counters.nrel_memb);
-    vectors.rel_memb_type.resize (counters.nrel_memb);
-    vectors.rel_ref.resize (counters.nrel_memb);
-    vectors.rel_role.resize (counters.nrel_memb);
-
-    vectors.way_id.resize (counters.nway_kv);
-    vectors.way_key.resize (counters.nway_kv);
-    vectors.way_val.resize (counters.nway_kv);
-
-    vectors.node_id.resize (counters.nnode_kv);
-    vectors.node_key.resize (counters.nnode_kv);
-    vectors.node_val.resize (counters.nnode_kv);
-
-    vectors.vx0.resize (counters.nedges);
-    vectors.vx1.resize (counters.nedges);
-    vectors.edge.resize (counters.nedges);
-    vectors.object.resize (counters.nedges);
-
-    vectors.vx.resize (counters.nnodes);
-    vectors.vy.resize (counters.nnodes);
-    vectors.vert_id.resize (counters.nnodes);
-
-    for (auto m: relSizes)
-    {
-        maps.rel_membs.emplace (m.first, std::vector <std::string> (m.second));
-    }
-    for (auto m: waySizes)
-    {
-        maps.way_membs.emplace (m.first, std::vector <std::string> (m.second));
-    }
-}
-
 /************************************************************************
  ************************************************************************
  **                                                                    **
- **                         FUNCTION::GETSIZES                         **
+ **                      FUNCTION::START_ELEMENT                       **
  **                                                                    **
  ************************************************************************
  ************************************************************************/
 
-inline void XmlDataSC::getSizes (XmlNodePtr pt)
+template <typename Id>
+inline void XmlDataSC <Id>::start_element (const char * name, size_t len,
+        const xml_stream::Attrs &attrs)
 {
-    for (XmlNodePtr it = pt->first_node (); it != nullptr;
-            it = it->next_sibling())
+    ParseState &s = m_state;
+    if (s.current == Element::none)
     {
-        if (!strcmp (it->name(), "node"))
+        if (len == 4 && !strncmp (name, "node", 4))
         {
-            countNode (it); // increments nnode_kv
-            counters.nnodes++;
-        }
-        else if (!strcmp (it->name(), "way"))
-        {
-            size_t wayLength = counters.nedges;
-            countWay (it); // increments nway_kv, nedges
-            wayLength = counters.nedges - wayLength;
-            counters.nedges--; // counts nodes, so each way has nedges = 1 - nnodes
-            waySizes.emplace (counters.id, wayLength);
-            counters.nways++;
-        }
-        else if (!strcmp (it->name(), "relation"))
-        {
-            size_t relLength = counters.nrel_memb;
-            countRelation (it); // increments nrel_kv, nrel_memb
-            relLength = counters.nrel_memb - relLength;
-            relSizes.emplace (counters.id, relLength);
-            counters.nrels++;
-        }
+            s.current = Element::node;
+            // Filled in by traverseNode, whatever the order of attributes
+            vectors.vert_id.emplace_back ();
+            vectors.vx.push_back (0.0);
+            vectors.vy.push_back (0.0);
+        } else if (len == 3 && !strncmp (name, "way", 3))
+            s.current = Element::way;
+        else if (len == 8 && !strncmp (name, "relation", 8))
+            s.current = Element::relation;
         else
         {
-            getSizes (it);
+            read_osm_meta (name, len, attrs, m_meta);
+            return;
         }
+        s.depth = 0;
+        s.memb_num = 0;
     }
-} // end function XmlDataSC::getSizes
 
+    s.depth++;
+    if (!keep_tag (attrs, m_opts))
+        return;
 
-/************************************************************************
- ************************************************************************
- **                                                                    **
- **                       FUNCTION::COUNTRELATION                      **
- **                                                                    **
- ************************************************************************
- ************************************************************************/
-
-inline void XmlDataSC::countRelation (XmlNodePtr pt)
-{
-    // Relations can have either members or key-val pairs, counted here with
-    // seperate counters
-    for (XmlAttrPtr it = pt->first_attribute (); it != nullptr;
-            it = it->next_attribute())
-    {
-        if (!strcmp (it->name(), "id"))
-            counters.id = it->value();
-        else if (!strcmp (it->name(), "type"))
-            counters.nrel_memb++;
-        else if (!strcmp (it->name(), "k"))
-            counters.nrel_kv++;
-    }
-    // allows for >1 child nodes
-    for (XmlNodePtr it = pt->first_node(); it != nullptr; it = it->next_sibling())
-    {
-        countRelation (it);
-    }
-} // end function XmlDataSC::countRelation
+    if (s.current == Element::node)
+        traverseNode (attrs);
+    else if (s.current == Element::way)
+        traverseWay (attrs);
+    else
+        traverseRelation (attrs);
+} // end function XmlDataSC::start_element
 
 
 /************************************************************************
  ************************************************************************
  **                                                                    **
- **                          FUNCTION::COUNTWAY                        **
+ **                       FUNCTION::END_ELEMENT                        **
  **                                                                    **
  ************************************************************************
  ************************************************************************/
 
-inline void XmlDataSC::countWay (XmlNodePtr pt)
+template <typename Id>
+inline void XmlDataSC <Id>::end_element (const char * name, size_t len)
 {
-    // Ways can have either member nodes, called "ref", or key-val pairs
-    for (XmlAttrPtr it = pt->first_attribute (); it != nullptr;
-            it = it->next_attribute())
-    {
-        if (!strcmp (it->name(), "id"))
-            counters.id = it->value();
-        else if (!strcmp (it->name(), "k"))
-            counters.nway_kv++;
-        else if (!strcmp (it->name(), "ref"))
-            counters.nedges++;
-    }
-    // allows for >1 child nodes
-    for (XmlNodePtr it = pt->first_node(); it != nullptr; it = it->next_sibling())
-    {
-        countWay (it);
-    }
-} // end function XmlDataSC::countWay
-
-
-/************************************************************************
- ************************************************************************
- **                                                                    **
- **                        FUNCTION::COUNTNODE                         **
- **                                                                    **
- ************************************************************************
- ************************************************************************/
+    ParseState &s = m_state;
+    if (s.current == Element::none || --s.depth > 0)
+        return;
 
-inline void XmlDataSC::countNode (XmlNodePtr pt)
-{
-    for (XmlAttrPtr it = pt->first_attribute (); it != nullptr;
-            it = it->next_attribute())
-    {
-        if (!strcmp (it->name(), "k"))
-            counters.nnode_kv++;
-    }
-    // allows for >1 child nodes
-    for (XmlNodePtr it = pt->first_node(); it != nullptr; it = it->next_sibling())
-    {
-        countNode (it);
-    }
-} // end function XmlDataSC::countNode
-
-
-/************************************************************************
- ************************************************************************
- **                                                                    **
- **                       FUNCTION::TRAVERSEWAYS                      **
- **                                                                    **
- ************************************************************************
- ************************************************************************/
-
-inline void XmlDataSC::traverseWays (XmlNodePtr pt)
-{
-    for (XmlNodePtr it = pt->first_node (); it != nullptr;
-            it = it->next_sibling())
-    {
-        if (!strcmp (it->name(), "node"))
-        {
-            traverseNode (it);
-            counters.nnodes++;
-        } else if (!strcmp (it->name(), "way"))
-        {
-            size_t node_num = 0;
-            traverseWay (it, node_num);
-            counters.nways++;
-        }
-        else if (!strcmp (it->name(), "relation"))
-        {
-            size_t memb_num = 0;
-            traverseRelation (it, memb_num);
-            counters.nrels++;
-        }
-        else
-        {
-            traverseWays (it);
-        }
-    }
-
-} // end function XmlDataSC::traverseWays
+    s.current = Element::none;
+} // end function XmlDataSC::end_element
 
 
 /************************************************************************
@@ -398,38 +361,37 @@ inline void XmlDataSC::traverseWays (XmlNodePtr pt)
  ************************************************************************
  ************************************************************************/
 
-inline void XmlDataSC::traverseRelation (XmlNodePtr pt, size_t &memb_num)
+template <typename Id>
+inline void XmlDataSC <Id>::traverseRelation (const xml_stream::Attrs &attrs)
 {
-    for (XmlAttrPtr it = pt->first_attribute (); it != nullptr;
-            it = it->next_attribute())
+    ParseState &s = m_state;
+    for (auto it = attrs.begin (); it != attrs.end (); ++it)
     {
-        if (!strcmp (it->name(), "id"))
+        if (it->name_is ("id"))
         {
             // These values are always first, so all other clauses are executed
             // after this one
-            counters.id = it->value();
-        } else if (!strcmp (it->name(), "k"))
+            s.id = SCId <Id>::read (*it);
+            lists.rel_membs.open (s.id);
+        } else if (it->name_is ("k"))
         {
-            vectors.rel_kv_id [counters.nrel_kv] = counters.id;
-            vectors.rel_key [counters.nrel_kv] = it->value();
-        } else if (!strcmp (it->name(), "v"))
-            vectors.rel_val [counters.nrel_kv++] = it->value();
-        else if (!strcmp (it->name(), "type"))
+            vectors.rel_kv_id.push_back (s.id);
+            vectors.rel_key.push_back (it->str ());
+            vectors.rel_val.emplace_back ();
+        } else if (it->name_is ("v"))
+            vectors.rel_val.back () = it->str ();
+        else if (it->name_is ("type"))
         {
-            vectors.rel_memb_type [counters.nrel_memb] = it->value();
-            vectors.rel_memb_id [counters.nrel_memb] = counters.id;
-        } else if (!strcmp (it->name(), "ref"))
+            vectors.rel_memb_type.push_back (it->str ());
+            vectors.rel_memb_id.push_back (s.id);
+            vectors.rel_ref.emplace_back ();
+            vectors.rel_role.emplace_back ();
+        } else if (it->name_is ("ref"))
         {
-            vectors.rel_ref [counters.nrel_memb] = it->value();
-            // TODO: Is there a safer alternative to next line?
-            maps.rel_membs.at (counters.id) [memb_num++] = it->value();
-        } else if (!strcmp (it->name(), "role"))
-            vectors.rel_role [counters.nrel_memb++] = it->value();
-    }
-    // allows for >1 child nodes
-    for (XmlNodePtr it = pt->first_node(); it != nullptr; it = it->next_sibling())
-    {
-        traverseRelation (it, memb_num);
+            vectors.rel_ref.back () = SCId <Id>::read (*it);
+            lists.rel_membs.push_back (vectors.rel_ref.back ());
+        } else if (it->name_is ("role"))
+            vectors.rel_role.back () = it->str ();
     }
 } // end function XmlDataSC::traverseRelation
 
@@ -442,47 +404,40 @@ inline void XmlDataSC::traverseRelation (XmlNodePtr pt, size_t &memb_num)
  ************************************************************************
  ************************************************************************/
 
-inline void XmlDataSC::traverseWay (XmlNodePtr pt, size_t& node_num)
+template <typename Id>
+inline void XmlDataSC <Id>::traverseWay (const xml_stream::Attrs &attrs)
 {
-    for (XmlAttrPtr it = pt->first_attribute (); it != nullptr;
-            it = it->next_attribute())
+    ParseState &s = m_state;
+    for (auto it = attrs.begin (); it != attrs.end (); ++it)
     {
-        if (!strcmp (it->name(), "id"))
+        if (it->name_is ("id"))
         {
             // These values are always first, so all other clauses are executed
             // after this one
-            counters.id = it->value();
-        } else if (!strcmp (it->name(), "k"))
+            s.id = SCId <Id>::read (*it);
+            lists.way_membs.open (s.id);
+        } else if (it->name_is ("k"))
         {
-            vectors.way_id [counters.nway_kv] = counters.id;
-            vectors.way_key [counters.nway_kv] = it->value();
-        } else if (!strcmp (it->name(), "v"))
-            vectors.way_val [counters.nway_kv++] = it->value();
-        else if (!strcmp (it->name(), "ref"))
+            vectors.way_id.push_back (s.id);
+            vectors.way_key.push_back (it->str ());
+            vectors.way_val.emplace_back ();
+        } else if (it->name_is ("v"))
+            vectors.way_val.back () = it->str ();
+        else if (it->name_is ("ref"))
         {
-            maps.way_membs.at (counters.id) [node_num] = it->value();
-            if (node_num == 0)
-                vectors.vx0 [counters.nedges] = it->value();
-            else
+            Id ref = SCId <Id>::read (*it);
+            lists.way_membs.push_back (ref);
+            if (s.memb_num > 0)
             {
-                vectors.vx1 [counters.nedges] = it->value();
-                vectors.object [counters.nedges] = counters.id;
-                vectors.edge [counters.nedges] = random_id (10);
-                counters.nedges++;
-                if (counters.nedges < vectors.vx0.size ())
-                {
-                    vectors.vx0 [counters.nedges] = it->value();
-                }
+                vectors.vx0.push_back (std::move (s.last_ref));
+                vectors.vx1.push_back (ref);
+                vectors.object.push_back (s.id);
+                vectors.edge.push_back (SCId <Id>::edge (s.id, s.memb_num));
             }
-            node_num++;
+            s.last_ref = std::move (ref);
+            s.memb_num++;
         }
     }
-
-    // allows for >1 child nodes
-    for (XmlNodePtr it = pt->first_node(); it != nullptr; it = it->next_sibling())
-    {
-        traverseWay (it, node_num);
-    }
 } // end function XmlDataSC::traverseWay
 
 
@@ -494,31 +449,26 @@ inline void XmlDataSC::traverseWay (XmlNodePtr pt, size_t& node_num)
  ************************************************************************
  ************************************************************************/
 
-inline void XmlDataSC::traverseNode (XmlNodePtr pt)
+template <typename Id>
+inline void XmlDataSC <Id>::traverseNode (const xml_stream::Attrs &attrs)
 {
-    for (XmlAttrPtr it = pt->first_attribute (); it != nullptr;
-            it = it->next_attribute())
+    const size_t i = vectors.vert_id.size () - 1;
+    for (auto it = attrs.begin (); it != attrs.end (); ++it)
     {
-        if (!strcmp (it->name(), "id"))
-            vectors.vert_id [counters.nnodes] = it->value();
-        else if (!strcmp (it->name(), "lat"))
-            vectors.vy [counters.nnodes] = std::stod(it->value());
-        else if (!strcmp (it->name(), "lon"))
-            vectors.vx [counters.nnodes] = std::stod(it->value());
-        else if (!strcmp (it->name(), "k"))
-            vectors.node_key [counters.nnode_kv] = it->value();
-        else if (!strcmp (it->name(), "v"))
+        if (it->name_is ("id"))
+            vectors.vert_id [i] = SCId <Id>::read (*it);
+        else if (it->name_is ("lat"))
+            vectors.vy.set (i, it->to_double ());
+        else if (it->name_is ("lon"))
+            vectors.vx.set (i, it->to_double ());
+        else if (it->name_is ("k"))
         {
-            vectors.node_val [counters.nnode_kv] = it->value();
-            vectors.node_id [counters.nnode_kv] =
-                vectors.vert_id [counters.nnodes]; // will always be pre-set
-            counters.nnode_kv++;
+            vectors.node_id.push_back (vectors.vert_id [i]); // always pre-set
+            vectors.node_key.push_back (it->str ());
+            vectors.node_val.emplace_back ();
         }
-    }
-    // allows for >1 child nodes
-    for (XmlNodePtr it = pt->first_node(); it != nullptr; it = it->next_sibling())
-    {
-        traverseNode (it);
+        else if (it->name_is ("v"))
+            vectors.node_val.back () = it->str ();
     }
 } // end function XmlDataSC::traverseNode
 
@@ -531,5 +481,15 @@ inline void XmlDataSC::traverseNode (XmlNodePtr pt)
  ************************************************************************
  ************************************************************************/
 
-Rcpp::List rel_membs_as_list (XmlDataSC &xml);
-Rcpp::List way_membs_as_list (XmlDataSC &xml);
+template <typename Id>
+Rcpp::List membs_as_list (const MemberLists <Id> &membs);
+
+namespace osm_sc {
+
+template <typename Id>
+Rcpp::List get_osmdata (const XmlDataSC <Id> &xml);
+
+} // end namespace osm_sc
+
+Rcpp::List rcpp_osmdata_sc (const std::string& st);
+Rcpp::List rcpp_osmdata_sc_file (const std::string& filename);
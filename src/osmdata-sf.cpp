@@ -24,12 +24,13 @@
  *
  *  Limitations:
  *
- *  Dependencies:       none (rapidXML header included in osmdata)
+ *  Dependencies:       none
  *
  *  Compiler Options:   -std=c++11
  ***************************************************************************/
 
 #include "osmdata.h"
+#include "mmap-file.h"
 
 #include <Rcpp.h>
 
@@ -58,15 +59,18 @@
 //' @param ways Pointer to the vector of way objects
 //' @param unique_vals Pointer to a UniqueVals object containing std::sets of all
 //'       unique IDs and keys for each kind of OSM object (nodes, ways, rels).
+//' @param merge_lines Join the member ways of multilinestrings which share end
+//'       nodes.
 //'
 //' @return A dual Rcpp::List, the first of which contains the multipolygon
 //'         relations; the second the multilinestring relations.
 //' 
 //' @noRd 
 Rcpp::List osm_sf::get_osm_relations (const Relations &rels, 
-        const std::map <osmid_t, Node> &nodes,
-        const std::map <osmid_t, OneWay> &ways, const UniqueVals &unique_vals,
-        const Rcpp::NumericVector &bbox, const Rcpp::List &crs)
+        const Nodes &nodes,
+        const Ways &ways, const UniqueVals &unique_vals,
+        const Rcpp::NumericVector &bbox, const Rcpp::List &crs,
+        const bool merge_lines)
 {
     /* Trace all multipolygon relations. These are the only OSM types where
      * sizes are not known before, so lat-lons and node names are stored in
@@ -111,6 +115,7 @@ Rcpp::List osm_sf::get_osm_relations (const Relations &rels,
 
     Rcpp::CharacterMatrix kv_mat_mp (Rcpp::Dimension (nmp, ncol)),
         kv_mat_ls (Rcpp::Dimension (nls, ncol));
+    osm_convert::StringCache strings (unique_vals.strings);
     unsigned int count_mp = 0, count_ls = 0;
 
     for (auto itr = rels.begin (); itr != rels.end (); ++itr)
@@ -138,7 +143,7 @@ Rcpp::List osm_sf::get_osm_relations (const Relations &rels,
             ids_mp.clear ();
             ids_mp.shrink_to_fit ();
 
-            osm_convert::get_value_mat_rel (itr, unique_vals, kv_mat_mp, count_mp++);
+            osm_convert::get_value_mat_rel (itr, unique_vals, strings, kv_mat_mp, count_mp++);
         } else // store as multilinestring
         {
             // multistrings are grouped here by roles, unlike GDAL which just
@@ -153,7 +158,7 @@ Rcpp::List osm_sf::get_osm_relations (const Relations &rels,
             for (std::string role: roles)
             {
                 trace_multilinestring (itr, role, ways, nodes, 
-                        lon_vec, lat_vec, rowname_vec, ids_ls);
+                        lon_vec, lat_vec, rowname_vec, ids_ls, merge_lines);
                 std::stringstream ss;
                 ss.str ("");
                 if (role == "")
@@ -175,7 +180,7 @@ Rcpp::List osm_sf::get_osm_relations (const Relations &rels,
                 ids_ls.clear ();
                 ids_ls.shrink_to_fit ();
 
-                osm_convert::get_value_mat_rel (itr, unique_vals, kv_mat_ls, count_ls++);
+                osm_convert::get_value_mat_rel (itr, unique_vals, strings, kv_mat_ls, count_ls++);
             }
             roles_ls.push_back (roles);
             roles.clear ();
@@ -217,9 +222,8 @@ Rcpp::List osm_sf::get_osm_relations (const Relations &rels,
         kv_mat_mp = kv_mat_mp2;
     }
 
-    Rcpp::List polygonList = osm_convert::convert_poly_linestring_to_sf <std::string>
-        (lon_arr_mp, lat_arr_mp, rowname_arr_mp, id_vec_mp, rel_id_mp,
-         "MULTIPOLYGON");
+    Rcpp::List polygonList = osm_convert::convert_multipoly_to_sf
+        (lon_arr_mp, lat_arr_mp, rowname_arr_mp, id_vec_mp, rel_id_mp);
     polygonList.attr ("n_empty") = 0;
     polygonList.attr ("class") = 
         Rcpp::CharacterVector::create ("sfc_MULTIPOLYGON", "sfc");
@@ -316,8 +320,8 @@ void osm_sf::get_osm_ways (Rcpp::List &wayList, Rcpp::DataFrame &kv_df,
     std::vector <std::string> waynames;
     waynames.reserve (way_ids.size ());
 
-    Rcpp::CharacterMatrix kv_mat (Rcpp::Dimension (nrow, ncol));
-    std::fill (kv_mat.begin (), kv_mat.end (), NA_STRING);
+    osm_convert::KeyValColumns kv_cols (nrow, ncol);
+    osm_convert::StringCache strings (unique_vals.strings);
     unsigned int count = 0;
     for (auto wi = way_ids.begin (); wi != way_ids.end (); ++wi)
     {
@@ -341,7 +345,9 @@ void osm_sf::get_osm_ways (Rcpp::List &wayList, Rcpp::DataFrame &kv_df,
             wayList [count] = polyList_temp;
         }
         auto wj = ways.find (*wi);
-        osm_convert::get_value_mat_way (wj, unique_vals, kv_mat, count);
+        for (auto &kv: wj->second.key_val)
+            kv_cols.set (count, unique_vals.k_way_index [kv.first],
+                    strings.get (kv.second));
         count++;
     }
 
@@ -357,13 +363,8 @@ void osm_sf::get_osm_ways (Rcpp::List &wayList, Rcpp::DataFrame &kv_df,
     wayList.attr ("crs") = crs;
 
     kv_df = R_NilValue;
-    if (way_ids.size () > 0)
-    {
-        kv_mat.attr ("names") = unique_vals.k_way;
-        kv_mat.attr ("dimnames") = Rcpp::List::create (waynames, unique_vals.k_way);
-        if (kv_mat.nrow () > 0 && kv_mat.ncol () > 0)
-            kv_df = osm_convert::restructure_kv_mat (kv_mat, false);
-    }
+    if (nrow > 0 && ncol > 0)
+        kv_df = kv_cols.as_data_frame (waynames, unique_vals.k_way);
 }
 
 //' get_osm_nodes
@@ -373,57 +374,57 @@ void osm_sf::get_osm_ways (Rcpp::List &wayList, Rcpp::DataFrame &kv_df,
 //' @param ptxy Pointer to Rcpp::List to hold the resultant geometries
 //' @param kv_df Pointer to Rcpp::DataFrame to hold key-value pairs
 //' @param nodes Pointer to all nodes in data set
+//' @param hidden Mask of nodes which are not returned as points, or empty to
+//' return all nodes
 //' @param unique_vals pointer to all unique values (OSM IDs and keys) in data set
 //' @param bbox Pointer to the bbox needed for `sf` construction
 //' @param crs Pointer to the crs needed for `sf` construction
 //' 
 //' @noRd 
 void osm_sf::get_osm_nodes (Rcpp::List &ptList, Rcpp::DataFrame &kv_df,
-        const Nodes &nodes, const UniqueVals &unique_vals, 
+        const Nodes &nodes, const std::vector <bool> &hidden,
+        const UniqueVals &unique_vals, 
         const Rcpp::NumericVector &bbox, const Rcpp::List &crs)
 {
     size_t nrow = nodes.size (), ncol = unique_vals.k_point.size ();
+    if (!hidden.empty ())
+        nrow -= static_cast <size_t> (std::count (hidden.begin (),
+                    hidden.end (), true));
 
     if (static_cast <size_t> (ptList.size ()) != nrow)
         throw std::runtime_error ("points must have same size as nodes");
 
-    Rcpp::CharacterMatrix kv_mat (Rcpp::Dimension (nrow, ncol));
-    std::fill (kv_mat.begin (), kv_mat.end (), NA_STRING);
+    osm_convert::KeyValColumns kv_cols (nrow, ncol);
+    osm_convert::StringCache strings (unique_vals.strings);
 
     std::vector <std::string> ptnames;
-    ptnames.reserve (nodes.size ());
-    unsigned int count = 0;
-    for (auto ni = nodes.begin (); ni != nodes.end (); ++ni)
+    ptnames.reserve (nrow);
+    size_t count = 0;
+    for (size_t i = 0; i < nodes.size (); i++)
     {
-        // std::distance requires a static_cast which copies each instance and
-        // slows this down by lots of orders of magnitude
-        //unsigned int count = static_cast <unsigned int> (
-        //        std::distance (nodes.begin (), ni));
-        if (count % 1000 == 0)
+        if (i % 1000 == 0)
             Rcpp::checkUserInterrupt ();
+        if (!hidden.empty () && hidden [i])
+            continue;
 
         // These are pointers and so need to be explicitly recreated each time,
         // otherwise they all just point to the initial value.
         Rcpp::NumericVector ptxy = Rcpp::NumericVector::create (NA_REAL, NA_REAL);
         ptxy.attr ("class") = Rcpp::CharacterVector::create ("XY", "POINT", "sfg");
-        ptxy (0) = ni->second.lon;
-        ptxy (1) = ni->second.lat;
+        ptxy (0) = nodes.lon (i);
+        ptxy (1) = nodes.lat (i);
         ptList (count) = ptxy;
-        ptnames.push_back (std::to_string (ni->first));
-        for (auto kv_iter = ni->second.key_val.begin ();
-                kv_iter != ni->second.key_val.end (); ++kv_iter)
+        ptnames.push_back (std::to_string (nodes.id (i)));
+        for (size_t j = nodes.kv_begin (i); j < nodes.kv_end (i); j++)
         {
-            const std::string &key = kv_iter->first;
-            unsigned int ndi = unique_vals.k_point_index.at (key);
-            kv_mat (count, ndi) = kv_iter->second;
+            unsigned int ndi = unique_vals.k_point_index [nodes.key (j)];
+            kv_cols.set (count, ndi, strings.get (nodes.value (j)));
         }
         count++;
     }
-    if (unique_vals.k_point.size () > 0)
-    {
-        kv_mat.attr ("dimnames") = Rcpp::List::create (ptnames, unique_vals.k_point);
-        kv_df = osm_convert::restructure_kv_mat (kv_mat, false);
-    } else
+    if (ncol > 0)
+        kv_df = kv_cols.as_data_frame (ptnames, unique_vals.k_point);
+    else
         kv_df = R_NilValue;
 
     ptList.attr ("names") = ptnames;
@@ -444,31 +445,18 @@ void osm_sf::get_osm_nodes (Rcpp::List &ptList, Rcpp::DataFrame &kv_df,
  ************************************************************************
  ************************************************************************/
 
-//' rcpp_osmdata_sf
+//' get_osmdata
 //'
-//' Return OSM data in Simple Features format
+//' Convert the contents of an XmlData object to Simple Features format
 //'
-//' @param st Text contents of an overpass API query
+//' @param xml Pointer to the parsed XmlData object
 //' @return Rcpp::List objects of OSM data
 //' 
 //' @noRd 
-// [[Rcpp::export]]
-Rcpp::List rcpp_osmdata_sf (const std::string& st)
+Rcpp::List osm_sf::get_osmdata (const XmlData &xml)
 {
-#ifdef DUMP_INPUT
-    {
-        std::ofstream dump ("./osmdata-sf.xml");
-        if (dump.is_open())
-        {
-            dump.write (st.c_str(), st.size());
-        }
-    }
-#endif
-
-    XmlData xml (st);
-
-    const std::map <osmid_t, Node>& nodes = xml.nodes ();
-    const std::map <osmid_t, OneWay>& ways = xml.ways ();
+    const Nodes& nodes = xml.nodes ();
+    const Ways& ways = xml.ways ();
     const std::vector <Relation>& rels = xml.relations ();
     const UniqueVals& unique_vals = xml.unique_vals ();
 
@@ -500,7 +488,7 @@ Rcpp::List rcpp_osmdata_sf (const std::string& st)
      * --------------------------------------------------------------*/
 
     Rcpp::List tempList = osm_sf::get_osm_relations (rels, nodes, ways, unique_vals,
-            bbox, crs);
+            bbox, crs, xml.options ().merge_lines);
     Rcpp::List multipolygons = tempList [0];
     // the followin line errors because of ambiguous conversion
     //Rcpp::DataFrame kv_df_mp = tempList [1]; 
@@ -518,6 +506,8 @@ Rcpp::List rcpp_osmdata_sf (const std::string& st)
     std::set <osmid_t> poly_ways, non_poly_ways;
     for (auto itw = ways.begin (); itw != ways.end (); ++itw)
     {
+        if (xml.is_hidden_way ((*itw).first))
+            continue;
         if ((*itw).second.nodes.front () == (*itw).second.nodes.back ())
         {
             if (poly_ways.find ((*itw).first) == poly_ways.end ())
@@ -540,20 +530,21 @@ Rcpp::List rcpp_osmdata_sf (const std::string& st)
      * 3. Extract OSM nodes
      * --------------------------------------------------------------*/
 
-    Rcpp::List pointList (nodes.size ());
+    Rcpp::List pointList (xml.n_points ());
     // NOTE: kv_df_points is actually an Rcpp::CharacterMatrix, and the
     // following line *should* construct the wrapped data.frame version with
     // strings not factors, yet this does not work.
     //Rcpp::DataFrame kv_df_points = Rcpp::DataFrame::create (Rcpp::_["stringsAsFactors"] = false);
     Rcpp::DataFrame kv_df_points;
-    osm_sf::get_osm_nodes (pointList, kv_df_points, nodes, unique_vals, bbox, crs);
+    osm_sf::get_osm_nodes (pointList, kv_df_points, xml.nodes (),
+            xml.hidden_nodes (), unique_vals, bbox, crs);
 
 
     /* --------------------------------------------------------------
      * 5. Collate all data
      * --------------------------------------------------------------*/
 
-    Rcpp::List ret (11);
+    Rcpp::List ret (12);
     ret [0] = bbox;
     ret [1] = pointList;
     ret [2] = kv_df_points;
@@ -565,12 +556,63 @@ Rcpp::List rcpp_osmdata_sf (const std::string& st)
     ret [8] = kv_df_mp;
     ret [9] = multilinestrings;
     ret [10] = kv_df_ls;
+    ret [11] = osm_convert::convert_meta_to_Rcpp (xml.meta ());
 
     std::vector <std::string> retnames {"bbox", "points", "points_kv",
         "lines", "lines_kv", "polygons", "polygons_kv",
         "multipolygons", "multipolygons_kv", 
-        "multilines", "multilines_kv"};
+        "multilines", "multilines_kv", "meta"};
     ret.attr ("names") = retnames;
     
     return ret;
 }
+
+//' rcpp_osmdata_sf
+//'
+//' Return OSM data in Simple Features format
+//'
+//' @param st Text contents of an overpass API query
+//' @param opts List of parsing options, as constructed by the R function
+//' `parse_options`
+//' @return Rcpp::List objects of OSM data
+//' 
+//' @noRd 
+// [[Rcpp::export]]
+Rcpp::List rcpp_osmdata_sf (const std::string& st,
+        Rcpp::List opts = Rcpp::List::create ())
+{
+#ifdef DUMP_INPUT
+    {
+        std::ofstream dump ("./osmdata-sf.xml");
+        if (dump.is_open())
+        {
+            dump.write (st.c_str(), st.size());
+        }
+    }
+#endif
+
+    XmlData xml (st, osm_convert::get_parse_options (opts));
+    return osm_sf::get_osmdata (xml);
+}
+
+//' rcpp_osmdata_sf_file
+//'
+//' Return OSM data from a file in Simple Features format. The file is
+//' memory-mapped and parsed without being copied.
+//'
+//' @param filename Full path to an OSM XML or .osm.pbf file, distinguished
+//' by content rather than name.
+//' @param opts List of parsing options, as constructed by the R function
+//' `parse_options`
+//' @return Rcpp::List objects of OSM data
+//' 
+//' @noRd 
+// [[Rcpp::export]]
+Rcpp::List rcpp_osmdata_sf_file (const std::string& filename,
+        Rcpp::List opts = Rcpp::List::create ())
+{
+    MappedFile f (filename);
+    XmlData xml (f.begin (), f.end (), pbf::is_pbf (f.begin (), f.end ()),
+            osm_convert::get_parse_options (opts));
+    return osm_sf::get_osmdata (xml);
+}
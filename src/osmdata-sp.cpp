@@ -24,12 +24,13 @@
  *
  *  Limitations:
  *
- *  Dependencies:       none (rapidXML header included in osmdata)
+ *  Dependencies:       none
  *
  *  Compiler Options:   -std=c++11
  ***************************************************************************/
 
 #include "osmdata.h"
+#include "mmap-file.h"
 
 #include <Rcpp.h>
 
@@ -47,39 +48,43 @@
 //' @param ptxy Pointer to Rcpp::List to hold the resultant geometries
 //' @param kv_mat Pointer to Rcpp::DataFrame to hold key-value pairs
 //' @param nodes Pointer to all nodes in data set
+//' @param hidden Mask of nodes which are not returned as points, or empty to
+//' return all nodes
 //' @param unique_vals pointer to all unique values (OSM IDs and keys) in data set
 //' @param bbox Pointer to the bbox needed for `sf` construction
 //' @param crs Pointer to the crs needed for `sf` construction
 //' 
 //' @noRd 
-void osm_sp::get_osm_nodes (Rcpp::S4 &sp_points, const Nodes &nodes, 
-        const UniqueVals &unique_vals)
+void osm_sp::get_osm_nodes (Rcpp::S4 &sp_points, const Nodes &nodes,
+        const std::vector <bool> &hidden, const UniqueVals &unique_vals)
 {
     Rcpp::NumericMatrix ptxy; 
     Rcpp::CharacterMatrix kv_mat;
     size_t nrow = nodes.size (), ncol = unique_vals.k_point.size ();
+    if (!hidden.empty ())
+        nrow -= static_cast <size_t> (std::count (hidden.begin (),
+                    hidden.end (), true));
 
     kv_mat = Rcpp::CharacterMatrix (Rcpp::Dimension (nrow, ncol));
     std::fill (kv_mat.begin (), kv_mat.end (), NA_STRING);
+    osm_convert::StringCache strings (unique_vals.strings);
 
     ptxy = Rcpp::NumericMatrix (Rcpp::Dimension (nrow, 2));
     std::vector <std::string> ptnames;
-    ptnames.reserve (nodes.size ());
-    unsigned int count = 0;
-    for (auto ni = nodes.begin (); ni != nodes.end (); ++ni)
+    ptnames.reserve (nrow);
+    size_t count = 0;
+    for (size_t i = 0; i < nodes.size (); i++)
     {
         Rcpp::checkUserInterrupt ();
-        ptxy (count, 0) = ni->second.lon;
-        ptxy (count, 1) = ni->second.lat;
-        ptnames.push_back (std::to_string (ni->first));
-        for (auto kv_iter = ni->second.key_val.begin ();
-                kv_iter != ni->second.key_val.end (); ++kv_iter)
+        if (!hidden.empty () && hidden [i])
+            continue;
+        ptxy (count, 0) = nodes.lon (i);
+        ptxy (count, 1) = nodes.lat (i);
+        ptnames.push_back (std::to_string (nodes.id (i)));
+        for (size_t j = nodes.kv_begin (i); j < nodes.kv_end (i); j++)
         {
-            const std::string &key = kv_iter->first;
-            unsigned int ndi = static_cast <unsigned int> (
-                    std::distance (unique_vals.k_point.begin (),
-                        unique_vals.k_point.find (key)));
-            kv_mat (count, ndi) = kv_iter->second;
+            unsigned int ndi = unique_vals.k_point_index [nodes.key (j)];
+            kv_mat (count, ndi) = strings.get (nodes.value (j));
         }
         count++;
     }
@@ -149,6 +154,7 @@ void osm_sp::get_osm_ways (Rcpp::S4 &sp_ways,
 
     Rcpp::CharacterMatrix kv_mat (Rcpp::Dimension (nrow, ncol));
     std::fill (kv_mat.begin (), kv_mat.end (), NA_STRING);
+    osm_convert::StringCache strings (unique_vals.strings);
     unsigned int count = 0;
     for (auto wi = way_ids.begin (); wi != way_ids.end (); ++wi)
     {
@@ -203,7 +209,7 @@ void osm_sp::get_osm_ways (Rcpp::S4 &sp_ways,
         }
         dummy_list.erase (0);
         auto wj = ways.find (*wi);
-        osm_convert::get_value_mat_way (wj, unique_vals, kv_mat, count++);
+        osm_convert::get_value_mat_way (wj, unique_vals, strings, kv_mat, count++);
     } // end for it over poly_ways
     if (indx_out.size () > 0)
     {
@@ -278,14 +284,17 @@ void osm_sp::get_osm_ways (Rcpp::S4 &sp_ways,
 //' @param ways Pointer to the vector of way objects
 //' @param unique_vals Pointer to a UniqueVals object containing std::sets of all
 //'        unique IDs and keys for each kind of OSM object (nodes, ways, rels).
+//' @param merge_lines Join the member ways of multilinestrings which share end
+//'        nodes.
 //'
 //' @return A dual Rcpp::List, the first of which contains the multipolygon
 //'         relations; the second the multilinestring relations.
 //' 
 //' @noRd 
 void osm_sp::get_osm_relations (Rcpp::S4 &multilines, Rcpp::S4 &multipolygons, 
-        const Relations &rels, const std::map <osmid_t, Node> &nodes,
-        const std::map <osmid_t, OneWay> &ways, const UniqueVals &unique_vals)
+        const Relations &rels, const Nodes &nodes,
+        const Ways &ways, const UniqueVals &unique_vals,
+        const bool merge_lines)
 {
     /* Trace all multipolygon relations. These are the only OSM types where
      * sizes are not known before, so lat-lons and node names are stored in
@@ -328,6 +337,7 @@ void osm_sp::get_osm_relations (Rcpp::S4 &multilines, Rcpp::S4 &multipolygons,
 
     Rcpp::CharacterMatrix kv_mat_mp (Rcpp::Dimension (nmp, ncol)),
         kv_mat_ls (Rcpp::Dimension (nls, ncol));
+    osm_convert::StringCache strings (unique_vals.strings);
     unsigned int count_mp = 0, count_ls = 0;
 
     for (auto itr = rels.begin (); itr != rels.end (); ++itr)
@@ -354,7 +364,7 @@ void osm_sp::get_osm_relations (Rcpp::S4 &multilines, Rcpp::S4 &multipolygons,
             ids_mp.shrink_to_fit ();
 
             if (nmp > 0)
-                osm_convert::get_value_mat_rel (itr, unique_vals, kv_mat_mp, count_mp++);
+                osm_convert::get_value_mat_rel (itr, unique_vals, strings, kv_mat_mp, count_mp++);
         } else // store as multilinestring
         {
             // multistrings are grouped here by roles, unlike GDAL which just
@@ -369,7 +379,7 @@ void osm_sp::get_osm_relations (Rcpp::S4 &multilines, Rcpp::S4 &multipolygons,
             for (std::string role: roles)
             {
                 trace_multilinestring (itr, role, ways, nodes, 
-                        lon_vec, lat_vec, rowname_vec, ids_ls);
+                        lon_vec, lat_vec, rowname_vec, ids_ls, merge_lines);
                 std::stringstream ss;
                 ss.str ("");
                 if (role == "")
@@ -392,7 +402,7 @@ void osm_sp::get_osm_relations (Rcpp::S4 &multilines, Rcpp::S4 &multipolygons,
                 ids_ls.shrink_to_fit ();
 
                 if (nls > 0)
-                    osm_convert::get_value_mat_rel (itr, unique_vals, kv_mat_ls, count_ls++);
+                    osm_convert::get_value_mat_rel (itr, unique_vals, strings, kv_mat_ls, count_ls++);
             }
             roles_ls.push_back (roles);
             roles.clear ();
@@ -429,33 +439,20 @@ void osm_sp::get_osm_relations (Rcpp::S4 &multilines, Rcpp::S4 &multipolygons,
 
 // [[Rcpp::depends(sp)]]
 
-//' rcpp_osmdata_sp
+//' get_osmdata
 //'
-//' Extracts all polygons from an overpass API query
+//' Convert the contents of an XmlData object to sp format
 //'
-//' @param st Text contents of an overpass API query
-//' @return A \code{SpatialLinesDataFrame} contains all polygons and associated data
+//' @param xml Pointer to the parsed XmlData object
+//' @return Rcpp::List objects of OSM data
 //' 
 //' @noRd 
-// [[Rcpp::export]]
-Rcpp::List rcpp_osmdata_sp (const std::string& st)
+Rcpp::List osm_sp::get_osmdata (const XmlData &xml)
 {
-#ifdef DUMP_INPUT
-    {
-        std::ofstream dump ("./osmdata-sp.xml");
-        if (dump.is_open())
-        {
-            dump.write (st.c_str(), st.size());
-        }
-    }
-#endif
-
-    XmlData xml (st);
-
-    const std::map <osmid_t, Node>& nodes = xml.nodes ();
-    const std::map <osmid_t, OneWay>& ways = xml.ways ();
+    const Nodes& nodes = xml.nodes ();
+    const Ways& ways = xml.ways ();
     const std::vector <Relation>& rels = xml.relations ();
-    const UniqueVals unique_vals = xml.unique_vals ();
+    const UniqueVals& unique_vals = xml.unique_vals ();
 
 
     /************************************************************************
@@ -470,6 +467,8 @@ Rcpp::List rcpp_osmdata_sp (const std::string& st)
     std::set <osmid_t> poly_ways, non_poly_ways;
     for (auto itw = ways.begin (); itw != ways.end (); ++itw)
     {
+        if (xml.is_hidden_way ((*itw).first))
+            continue;
         if ((*itw).second.nodes.front () == (*itw).second.nodes.back ())
         {
             if (poly_ways.find ((*itw).first) == poly_ways.end ())
@@ -490,9 +489,9 @@ Rcpp::List rcpp_osmdata_sp (const std::string& st)
     Rcpp::S4 sp_points, sp_lines, sp_polygons, sp_multilines, sp_multipolygons;
     osm_sp::get_osm_ways (sp_polygons, poly_ways, ways, nodes, unique_vals, "polygon");
     osm_sp::get_osm_ways (sp_lines, non_poly_ways, ways, nodes, unique_vals, "line");
-    osm_sp::get_osm_nodes (sp_points, nodes, unique_vals);
+    osm_sp::get_osm_nodes (sp_points, nodes, xml.hidden_nodes (), unique_vals);
     osm_sp::get_osm_relations (sp_multilines, sp_multipolygons, 
-            rels, nodes, ways, unique_vals);
+            rels, nodes, ways, unique_vals, xml.options ().merge_lines);
 
     // Add bbox and crs to each sp object
     Rcpp::NumericMatrix bbox = rcpp_get_bbox (xml.x_min (), xml.x_max (), 
@@ -512,17 +511,68 @@ Rcpp::List rcpp_osmdata_sp (const std::string& st)
     sp_multilines.slot ("proj4string") = crs;
     sp_multipolygons.slot ("proj4string") = crs;
 
-    Rcpp::List ret (6);
+    Rcpp::List ret (7);
     ret [0] = bbox;
     ret [1] = sp_points;
     ret [2] = sp_lines;
     ret [3] = sp_polygons;
     ret [4] = sp_multilines;
     ret [5] = sp_multipolygons;
+    ret [6] = osm_convert::convert_meta_to_Rcpp (xml.meta ());
 
     std::vector <std::string> retnames {"bbox", "points", "lines", "polygons",
-        "multilines", "multipolygons"};
+        "multilines", "multipolygons", "meta"};
     ret.attr ("names") = retnames;
     
     return ret;
 }
+
+//' rcpp_osmdata_sp
+//'
+//' Extracts all polygons from an overpass API query
+//'
+//' @param st Text contents of an overpass API query
+//' @param opts List of parsing options, as constructed by the R function
+//' `parse_options`
+//' @return A \code{SpatialLinesDataFrame} contains all polygons and associated data
+//' 
+//' @noRd 
+// [[Rcpp::export]]
+Rcpp::List rcpp_osmdata_sp (const std::string& st,
+        Rcpp::List opts = Rcpp::List::create ())
+{
+#ifdef DUMP_INPUT
+    {
+        std::ofstream dump ("./osmdata-sp.xml");
+        if (dump.is_open())
+        {
+            dump.write (st.c_str(), st.size());
+        }
+    }
+#endif
+
+    XmlData xml (st, osm_convert::get_parse_options (opts));
+    return osm_sp::get_osmdata (xml);
+}
+
+//' rcpp_osmdata_sp_file
+//'
+//' Return OSM data from a file in sp format. The file is memory-mapped and
+//' parsed without being copied.
+//'
+//' @param filename Full path to an OSM XML or .osm.pbf file, distinguished
+//' by content rather than name.
+//' @param opts List of parsing options, as constructed by the R function
+//' `parse_options`
+//' @return Rcpp::List objects of OSM data
+//' 
+//' @noRd 
+// [[Rcpp::export]]
+Rcpp::List rcpp_osmdata_sp_file (const std::string& filename,
+        Rcpp::List opts = Rcpp::List::create ())
+{
+    MappedFile f (filename);
+    XmlData xml (f.begin (), f.end (), pbf::is_pbf (f.begin (), f.end ()),
+            osm_convert::get_parse_options (opts));
+    return osm_sp::get_osmdata (xml);
+}
@@ -23,7 +23,7 @@
  *
  *  Limitations:
  *
- *  Dependencies:       none (rapidXML header included in osmdata)
+ *  Dependencies:       none
  *
  *  Compiler Options:   -std=c++11
  ***************************************************************************/
@@ -32,11 +32,19 @@
 
 #include <Rcpp.h>
 
+#include <algorithm> // std::min
+
 #include "common.h"
+#include "xml-stream.h"
+#include "pbf-reader.h"
+#include "threads.h"
 #include "get-bbox.h"
 #include "trace-osm.h"
 #include "convert-osm-rcpp.h"
 
+// Approximate size in bytes of chunks of XML documents parsed in parallel
+constexpr size_t XML_CHUNK_SIZE = 4 * 1024 * 1024;
+
 //const std::string crs = "+proj=longlat +ellps=WGS84 +datum=WGS84 +no_defs +towgs84=0,0,0";
 const std::string p4s = "+proj=longlat +datum=WGS84 +no_defs";
 
@@ -49,6 +57,8 @@ const std::string p4s = "+proj=longlat +datum=WGS84 +no_defs";
  ************************************************************************
  *
  * 1. osmdata.h = Class definition of XmlData that reads initial XML structure
+ *      via the streaming parser of xml-stream.h, or .osm.pbf files via the
+ *      decoder of pbf-reader.h
  * 2. trace_osm.h = Primary functions to trace ways and relations (pure C++)
  *      2a. trace_multipolygon ()
  *      2b. trace_multilinestring ()
@@ -59,6 +69,7 @@ const std::string p4s = "+proj=longlat +datum=WGS84 +no_defs";
  *      3c. get_value_mat_rel ()
  *      3d. convert_poly_linestring_to_Rcpp ()
  *      3e. restructure_kv_mat ()
+ *      3f. KeyValColumns
  * 4. osmdata.cpp
  *      5c. get_osm_relations ()
  *      5d. get_osm_ways ()
@@ -84,14 +95,281 @@ const std::string p4s = "+proj=longlat +datum=WGS84 +no_defs";
  *      -> get_osm_ways ()
  *      {
  *          -> trace_way_nmat ()
- *          -> get_value_mat_way ()
- *          -> restructure_kv_mat
+ *          -> KeyValColumns
  *      }
  *      -> get_osm_nodes ()
- *          -> restructure_kv_mat
+ *          -> KeyValColumns
  *  }
  */
 
+/************************************************************************
+ ************************************************************************
+ **                                                                    **
+ **                         CLASS::XMLREADER                           **
+ **                                                                    **
+ ************************************************************************
+ ************************************************************************
+ *
+ * Handler for xml_stream::Parser which reads OSM elements into RawNode,
+ * RawWay, and RawRelation structures. Each element is passed to
+ * Sink::add_node/add_way/add_relation once the closing tag of the top-level
+ * node/way/relation is reached, and header metadata are written to `meta`.
+ * Tags are filtered according to `opts` before they are stored. The Sink is
+ * either XmlData itself, or a RawBlock holding the elements of one chunk of a
+ * file parsed in parallel.
+ *
+ * All strings are stored as views into the input, except for values with
+ * character entities, which are translated and passed to Sink::keep, which
+ * must hold them until the element has been added.
+ */
+
+template <typename Sink>
+class XmlReader
+{
+    private:
+
+        Sink &m_sink;
+        OsmMeta &m_meta;
+        const ParseOptions &m_opts;
+
+        enum class Element { none, node, way, relation };
+        struct ParseState {
+            Element current = Element::none;
+            size_t depth = 0; // nesting depth within current element
+            RawNode rnode;
+            RawWay rway;
+            RawRelation rrel;
+        } m_state;
+
+        friend class xml_stream::Parser <XmlReader <Sink> >;
+
+    public:
+
+        XmlReader (Sink &sink, OsmMeta &meta, const ParseOptions &opts)
+            : m_sink (sink), m_meta (meta), m_opts (opts) {}
+
+        void parse (const char * begin, const char * end)
+        {
+            xml_stream::Parser <XmlReader <Sink> > parser (*this);
+            parser.parse (begin, end);
+        }
+
+    private:
+
+        // Callbacks for xml_stream::Parser
+        void start_element (const char * name, size_t len,
+                const xml_stream::Attrs &attrs);
+        void end_element (const char * name, size_t len);
+
+        void traverseRelation (const xml_stream::Attrs &attrs, RawRelation& rrel);
+        void traverseWay (const xml_stream::Attrs &attrs, RawWay& rway);
+        void traverseNode (const xml_stream::Attrs &attrs, RawNode& rnode);
+
+        StrView view (const xml_stream::Attr &a)
+        {
+            if (a.has_entities ())
+                return m_sink.keep (a.str ());
+            return StrView (a.value, a.value_len);
+        }
+
+}; // end Class::XmlReader
+
+
+/************************************************************************
+ ************************************************************************
+ **                                                                    **
+ **                      FUNCTION::START_ELEMENT                       **
+ **                                                                    **
+ ************************************************************************
+ ************************************************************************/
+
+// Equivalent to the former recursive DOM traversal: "node", "way", and
+// "relation" elements may appear at any depth, and the attributes of all of
+// their descendent elements (<tag>, <nd>, <member>) are read as their own.
+// All other elements are only inspected for header metadata.
+template <typename Sink>
+inline void XmlReader <Sink>::start_element (const char * name,
+        size_t len, const xml_stream::Attrs &attrs)
+{
+    ParseState &s = m_state;
+    if (s.current == Element::none)
+    {
+        if (len == 4 && !strncmp (name, "node", 4))
+        {
+            s.current = Element::node;
+            s.rnode.key.clear ();
+            s.rnode.value.clear ();
+        } else if (len == 3 && !strncmp (name, "way", 3))
+        {
+            s.current = Element::way;
+            s.rway.key.clear ();
+            s.rway.value.clear ();
+            s.rway.nodes.clear ();
+        } else if (len == 8 && !strncmp (name, "relation", 8))
+        {
+            s.current = Element::relation;
+            s.rrel.key.clear();
+            s.rrel.value.clear();
+            s.rrel.role_way.clear();
+            s.rrel.role_node.clear();
+            s.rrel.role_relation.clear();
+            s.rrel.ways.clear();
+            s.rrel.nodes.clear();
+            s.rrel.relations.clear();
+            s.rrel.member_type = StrView ();
+            s.rrel.ispoly = false;
+        } else
+        {
+            read_osm_meta (name, len, attrs, m_meta);
+            return;
+        }
+        s.depth = 0;
+    }
+
+    s.depth++;
+    if (!keep_tag (attrs, m_opts))
+        return;
+
+    if (s.current == Element::node)
+        traverseNode (attrs, s.rnode);
+    else if (s.current == Element::way)
+        traverseWay (attrs, s.rway);
+    else
+        traverseRelation (attrs, s.rrel);
+} // end function XmlReader::start_element
+
+
+/************************************************************************
+ ************************************************************************
+ **                                                                    **
+ **                       FUNCTION::END_ELEMENT                        **
+ **                                                                    **
+ ************************************************************************
+ ************************************************************************/
+
+template <typename Sink>
+inline void XmlReader <Sink>::end_element (const char * name, size_t len)
+{
+    ParseState &s = m_state;
+    if (s.current == Element::none || --s.depth > 0)
+        return;
+
+    if (s.current == Element::node)
+        m_sink.add_node (s.rnode);
+    else if (s.current == Element::way)
+        m_sink.add_way (s.rway);
+    else
+        m_sink.add_relation (s.rrel);
+    s.current = Element::none;
+} // end function XmlReader::end_element
+
+
+/************************************************************************
+ ************************************************************************
+ **                                                                    **
+ **                     FUNCTION::TRAVERSERELATION                     **
+ **                                                                    **
+ ************************************************************************
+ ************************************************************************/
+
+template <typename Sink>
+inline void XmlReader <Sink>::traverseRelation (const xml_stream::Attrs &attrs,
+        RawRelation& rrel)
+{
+    for (auto it = attrs.begin (); it != attrs.end (); ++it)
+    {
+        if (it->name_is ("k"))
+            rrel.key.push_back (view (*it));
+        else if (it->name_is ("v"))
+            rrel.value.push_back (view (*it));
+        else if (it->name_is ("id"))
+            rrel.id = it->to_integer ();
+        else if (it->name_is ("type"))
+            rrel.member_type = view (*it);
+        else if (it->name_is ("ref"))
+        {
+            if (rrel.member_type == "node")
+                rrel.nodes.push_back (it->to_integer ());
+            else if (rrel.member_type == "way")
+                rrel.ways.push_back (it->to_integer ());
+            else if (rrel.member_type == "relation")
+                rrel.relations.push_back (it->to_integer ());
+            else
+                throw std::runtime_error ("unknown member_type");
+        } else if (it->name_is ("role"))
+        {
+            if (rrel.member_type == "node")
+                rrel.role_node.push_back (view (*it));
+            else if (rrel.member_type == "way")
+                rrel.role_way.push_back (view (*it));
+            else if (rrel.member_type == "relation")
+                rrel.role_relation.push_back (view (*it));
+            else
+                throw std::runtime_error ("unknown member_type");
+            // Not all OSM Multipolygons have (key="type",
+            // value="multipolygon"): For example, (key="type",
+            // value="boundary") are often multipolygons. The things they all
+            // have are "inner" and "outer" roles.
+            if (it->value_is ("inner") || it->value_is ("outer"))
+                rrel.ispoly = true;
+        }
+    }
+} // end function XmlReader::traverseRelation
+
+
+/************************************************************************
+ ************************************************************************
+ **                                                                    **
+ **                        FUNCTION::TRAVERSEWAY                       **
+ **                                                                    **
+ ************************************************************************
+ ************************************************************************/
+
+template <typename Sink>
+inline void XmlReader <Sink>::traverseWay (const xml_stream::Attrs &attrs,
+        RawWay& rway)
+{
+    for (auto it = attrs.begin (); it != attrs.end (); ++it)
+    {
+        if (it->name_is ("k"))
+            rway.key.push_back (view (*it));
+        else if (it->name_is ("v"))
+            rway.value.push_back (view (*it));
+        else if (it->name_is ("id"))
+            rway.id = it->to_integer ();
+        else if (it->name_is ("ref"))
+            rway.nodes.push_back (it->to_integer ());
+    }
+} // end function XmlReader::traverseWay
+
+
+/************************************************************************
+ ************************************************************************
+ **                                                                    **
+ **                       FUNCTION::TRAVERSENODE                       **
+ **                                                                    **
+ ************************************************************************
+ ************************************************************************/
+
+template <typename Sink>
+inline void XmlReader <Sink>::traverseNode (const xml_stream::Attrs &attrs,
+        RawNode& rnode)
+{
+    for (auto it = attrs.begin (); it != attrs.end (); ++it)
+    {
+        if (it->name_is ("id"))
+            rnode.id = it->to_integer ();
+        else if (it->name_is ("lat"))
+            rnode.lat = it->to_double ();
+        else if (it->name_is ("lon"))
+            rnode.lon = it->to_double ();
+        else if (it->name_is ("k"))
+            rnode.key.push_back (view (*it));
+        else if (it->name_is ("v"))
+            rnode.value.push_back (view (*it));
+    }
+} // end function XmlReader::traverseNode
+
 /************************************************************************
  ************************************************************************
  **                                                                    **
@@ -105,21 +383,61 @@ class XmlData
 {
     private:
 
+        // Must precede, and so outlive, all objects allocated from it
+        Arena m_arena;
+
         Nodes m_nodes;
         Ways m_ways;
         Relations m_relations;
         UniqueVals m_unique;
+        OsmMeta m_meta;
+        ParseOptions m_opts;
+
+        // With a bounding polygon, nodes and ways which are retained only as
+        // parts of the geometries of other objects. Hidden nodes are flagged
+        // by their positions in m_nodes once parsing is complete.
+        std::unordered_set <osmid_t> m_hidden_nodes, m_hidden_ways;
+        std::vector <bool> m_node_hidden;
+        size_t m_n_hidden = 0;
+
+        KeyVals m_node_kv; // re-used for every node
+        IdIndex m_rel_index; // positions of ids in m_relations while parsing
+        // Translated XML values with character entities, which are the only
+        // strings of Raw objects not viewed within the input
+        std::deque <std::string> m_decoded;
+
+        friend class XmlReader <XmlData>;
 
     public:
 
         double xmin = DOUBLE_MAX, xmax = -DOUBLE_MAX,
               ymin = DOUBLE_MAX, ymax = -DOUBLE_MAX;
 
-        XmlData (const std::string& str)
+        XmlData (const std::string& str,
+                const ParseOptions &opts = ParseOptions ())
+            : XmlData (str.c_str (), str.c_str () + str.size (), false,
+                    opts) {}
+
+        // Parse directly from any contiguous buffer, such as a MappedFile,
+        // holding either OSM XML or, if `pbf` is true, an .osm.pbf file.
+        XmlData (const char * begin, const char * end, bool pbf = false,
+                const ParseOptions &opts = ParseOptions ())
+            : m_ways (Ways::allocator_type (&m_arena)), m_opts (opts)
         {
             // APS empty m_nodes/m_ways/m_relations constructed here, no need to explicitly clear
-            XmlDocPtr p = parseXML (str);
-            traverseWays (p->first_node ());
+            // The XML is streamed straight into m_nodes/m_ways/m_relations,
+            // so no DOM is ever constructed.
+            m_nodes.set_compact (m_opts.compact);
+            if (pbf)
+                read_pbf (begin, end, m_opts);
+            else
+                read_xml (begin, end, m_opts);
+            m_decoded.clear ();
+            m_rel_index.clear ();
+            m_nodes.finalise ();
+            if (m_opts.has_poly ())
+                trim_to_poly ();
+            index_way_nodes ();
             make_key_val_indices ();
         }
 
@@ -131,20 +449,51 @@ class XmlData
 
         // Const accessors for members
         const Nodes& nodes() const { return m_nodes; }
+        // Nodes are returned as points unless hidden, which happens only when
+        // parsing is restricted to a bounding polygon. The mask is otherwise
+        // empty.
+        const std::vector <bool>& hidden_nodes() const { return m_node_hidden; }
+        bool is_hidden_node (size_t i) const
+        {
+            return !m_node_hidden.empty () && m_node_hidden [i];
+        }
+        size_t n_points() const { return m_nodes.size () - m_n_hidden; }
+        bool is_hidden_way (osmid_t id) const
+        {
+            return m_hidden_ways.find (id) != m_hidden_ways.end ();
+        }
         const Ways& ways() const { return m_ways; }
         const Relations& relations() const { return m_relations; }
         const UniqueVals& unique_vals() const { return m_unique; }
-        double x_min() { return xmin;  }
-        double x_max() { return xmax;  }
-        double y_min() { return ymin;  }
-        double y_max() { return ymax;  }
+        const OsmMeta& meta() const { return m_meta; }
+        const ParseOptions& options() const { return m_opts; }
+        double x_min() const { return xmin;  }
+        double x_max() const { return xmax;  }
+        double y_min() const { return ymin;  }
+        double y_max() const { return ymax;  }
 
     private:
 
-        void traverseWays (XmlNodePtr pt);
-        void traverseRelation (XmlNodePtr pt, RawRelation& rrel);
-        void traverseWay (XmlNodePtr pt, RawWay& rway);
-        void traverseNode (XmlNodePtr pt, RawNode& rnode);
+        void read_xml (const char * begin, const char * end,
+                const ParseOptions &opts);
+        void read_pbf (const char * begin, const char * end,
+                const ParseOptions &opts);
+        void add_block (RawBlock &block);
+        void reset ();
+
+        void add_node (RawNode &rnode);
+        void add_way (RawWay &rway);
+        void add_relation (RawRelation &rrel);
+        StrView keep (std::string &&s)
+        {
+            m_decoded.push_back (std::move (s));
+            return StrView (m_decoded.back ());
+        }
+        bool node_in_poly (osmid_t id) const;
+        void trim_to_poly ();
+        void index_way_nodes ();
+        void intern_tags (const std::vector <StrView> &key,
+                const std::vector <StrView> &value, KeyVals &kv);
         void make_key_val_indices ();
 
 }; // end Class::XmlData
@@ -153,265 +502,517 @@ class XmlData
 /************************************************************************
  ************************************************************************
  **                                                                    **
- **                       FUNCTION::TRAVERSEWAYS                      **
+ **                          FUNCTION::READ_XML                        **
  **                                                                    **
  ************************************************************************
  ************************************************************************/
 
-inline void XmlData::traverseWays (XmlNodePtr pt)
+// Large documents are split into chunks aligned on the start tags of nodes,
+// ways, and relations. Chunks are parsed in parallel batches into RawBlocks,
+// which are merged strictly in document order, as for PBF blocks. Smaller
+// documents are streamed directly into this object.
+inline void XmlData::read_xml (const char * begin, const char * end,
+        const ParseOptions &opts)
 {
-    RawRelation rrel;
-    RawWay rway;
-    Relation relation;
-    OneWay way;
-    RawNode rnode;
-    Node node;
-
-    for (XmlNodePtr it = pt->first_node (); it != nullptr;
-            it = it->next_sibling())
+    const int nthreads = osm_threads::max_threads ();
+    const size_t size = static_cast <size_t> (end - begin);
+    const size_t chunk_size = opts.chunk_size > 0 ?
+        opts.chunk_size : XML_CHUNK_SIZE;
+    if ((nthreads == 1 && opts.chunk_size == 0) || size < 2 * chunk_size)
     {
-        if (!strcmp (it->name(), "node"))
-        {
-            rnode.key.clear ();
-            rnode.value.clear ();
+        XmlReader <XmlData> reader (*this, m_meta, opts);
+        reader.parse (begin, end);
+        return;
+    }
+
+    const std::vector <const char *> bounds = xml_stream::split_at_elements (
+            begin, end, chunk_size, {"node", "way", "relation"});
+    const size_t nchunks = bounds.size () - 1;
+
+    const size_t batch_size = 2 * static_cast <size_t> (nthreads);
+    std::vector <RawBlock> blocks (std::min (batch_size, nchunks));
+    std::vector <OsmMeta> metas (blocks.size ());
+    std::vector <std::string> errors (blocks.size ());
 
-            traverseNode (it, rnode);
-            if (rnode.key.size () != rnode.value.size ())
-                throw std::runtime_error ("sizes of keys and values differ");
+    for (size_t c0 = 0; c0 < nchunks; c0 += batch_size)
+    {
+        const long nc = static_cast <long> (std::min (batch_size,
+                    nchunks - c0));
 
-            // Only insert unique nodes
-            if (m_unique.id_node.find (rnode.id) == m_unique.id_node.end ())
+        #pragma omp parallel for schedule(dynamic) num_threads(nthreads)
+        for (long i = 0; i < nc; i++)
+        {
+            const size_t ci = static_cast <size_t> (i);
+            try
             {
-                if (rnode.lon < xmin) xmin = rnode.lon;
-                if (rnode.lon > xmax) xmax = rnode.lon;
-                if (rnode.lat < ymin) ymin = rnode.lat;
-                if (rnode.lat > ymax) ymax = rnode.lat;
-                m_unique.id_node.insert (rnode.id);
-                node.id = rnode.id;
-                node.lat = rnode.lat;
-                node.lon = rnode.lon;
-                node.key_val.clear ();
-                for (size_t i=0; i<rnode.key.size (); i++)
-                {
-                    node.key_val.insert (std::make_pair
-                            (rnode.key [i], rnode.value [i]));
-                    m_unique.k_point.insert (rnode.key [i]); // only inserts unique keys
-                }
-                m_nodes.insert (std::make_pair (node.id, node));
+                blocks [ci].clear ();
+                XmlReader <RawBlock> reader (blocks [ci], metas [ci],
+                        opts);
+                reader.parse (bounds [c0 + ci], bounds [c0 + ci + 1]);
+            } catch (std::exception &e)
+            {
+                errors [ci] = e.what ();
             }
         }
-        else if (!strcmp (it->name(), "way"))
-        {
-            rway.key.clear ();
-            rway.value.clear ();
-            rway.nodes.clear ();
 
-            traverseWay (it, rway);
-            if (rway.key.size () != rway.value.size ())
-                throw std::runtime_error ("sizes of keys and values differ");
-
-            if (m_unique.id_way.find (rway.id) == m_unique.id_way.end ())
+        for (size_t i = 0; i < static_cast <size_t> (nc); i++)
+        {
+            if (!errors [i].empty ())
             {
-                m_unique.id_way.insert (rway.id);
-                way.id = rway.id;
-                way.key_val.clear();
-                way.nodes.clear();
-                for (size_t i=0; i<rway.key.size (); i++)
-                {
-                    way.key_val.insert (std::make_pair
-                            (rway.key [i], rway.value [i]));
-                    m_unique.k_way.insert (rway.key [i]);
-                }
-                // Then copy nodes from rway to way.
-                way.nodes.swap (rway.nodes);
-                m_ways.insert (std::make_pair (way.id, way));
+                // Most likely a chunk boundary within a comment or CDATA
+                // section (see xml_stream::split_at_elements), otherwise the
+                // error recurs when parsing as a single piece.
+                reset ();
+                XmlReader <XmlData> reader (*this, m_meta, opts);
+                reader.parse (begin, end);
+                return;
             }
+            add_block (blocks [i]);
+            if (m_meta.timestamp.empty ())
+                m_meta.timestamp = metas [i].timestamp;
+            if (m_meta.osm_version.empty ())
+                m_meta.osm_version = metas [i].osm_version;
+            if (m_meta.generator.empty ())
+                m_meta.generator = metas [i].generator;
         }
-        else if (!strcmp (it->name(), "relation"))
+    }
+} // end function XmlData::read_xml
+
+inline void XmlData::reset ()
+{
+    m_nodes.clear ();
+    m_ways.clear ();
+    m_relations.clear ();
+    m_unique = UniqueVals ();
+    m_meta = OsmMeta ();
+    m_hidden_nodes.clear ();
+    m_hidden_ways.clear ();
+    m_node_hidden.clear ();
+    m_n_hidden = 0;
+    m_decoded.clear ();
+    m_rel_index.clear ();
+    m_arena.release ();
+    xmin = ymin = DOUBLE_MAX;
+    xmax = ymax = -DOUBLE_MAX;
+} // end function XmlData::reset
+
+
+/************************************************************************
+ ************************************************************************
+ **                                                                    **
+ **                          FUNCTION::READ_PBF                        **
+ **                                                                    **
+ ************************************************************************
+ ************************************************************************/
+
+// PBF elements are decoded into the same Raw structures used for XML, and
+// then added exactly as if read from XML. Blobs are inflated and decoded in
+// parallel batches, each into its own RawBlock, which are merged strictly in
+// file order so that results are identical for any number of threads.
+inline void XmlData::read_pbf (const char * begin, const char * end,
+        const ParseOptions &opts)
+{
+    const std::vector <pbf::BlobRef> blobs = pbf::split_blobs (begin, end);
+
+    std::vector <pbf::BlobRef> data_blobs;
+    std::vector <char> buf;
+    for (auto b: blobs)
+    {
+        if (b.is_header)
+        {
+            const char * data;
+            size_t len;
+            pbf::blob_data (b, buf, data, len);
+            pbf::decode_header (data, len, m_meta);
+        } else
+            data_blobs.push_back (b);
+    }
+
+    const int nthreads = osm_threads::max_threads ();
+    const size_t batch_size = 4 * static_cast <size_t> (nthreads);
+    std::vector <RawBlock> blocks (std::min (batch_size, data_blobs.size ()));
+    std::vector <std::string> errors (blocks.size ());
+
+    for (size_t b0 = 0; b0 < data_blobs.size (); b0 += batch_size)
+    {
+        const long nb = static_cast <long> (std::min (batch_size,
+                    data_blobs.size () - b0));
+
+        // Exceptions can not propagate out of OpenMP regions, so are
+        // collected and re-thrown below
+        #pragma omp parallel for schedule(dynamic) num_threads(nthreads)
+        for (long i = 0; i < nb; i++)
         {
-            rrel.key.clear();
-            rrel.value.clear();
-            rrel.role_way.clear();
-            rrel.role_node.clear();
-            rrel.ways.clear();
-            rrel.nodes.clear();
-            rrel.member_type = "";
-            rrel.ispoly = false;
-
-            traverseRelation (it, rrel);
-            if (rrel.key.size () != rrel.value.size ())
-                throw std::runtime_error ("sizes of keys and values differ");
-            if (rrel.ways.size () != rrel.role_way.size ())
-                throw std::runtime_error ("size of ways and roles differ");
-            if (rrel.nodes.size () != rrel.role_node.size ())
-                throw std::runtime_error ("size of nodes and roles differ");
-
-            if (m_unique.id_rel.find (rrel.id) == m_unique.id_rel.end ())
+            const size_t bi = static_cast <size_t> (i);
+            try
+            {
+                // Strings are viewed within the decompressed data, which are
+                // thus held by the block until it is merged
+                const char * data;
+                size_t len;
+                pbf::blob_data (data_blobs [b0 + bi], blocks [bi].buffer,
+                        data, len);
+                pbf::decode_block (data, len, blocks [bi], opts);
+            } catch (std::exception &e)
             {
-                m_unique.id_rel.insert (rrel.id);
-                relation.id = rrel.id;
-                relation.key_val.clear();
-                relation.ways.clear();
-                relation.ispoly = rrel.ispoly;
-                for (size_t i=0; i<rrel.key.size (); i++)
-                {
-                    relation.key_val.insert (std::make_pair (rrel.key [i],
-                                rrel.value [i]));
-                    m_unique.k_rel.insert (rrel.key [i]);
-                    if (rrel.key [i] == "type")
-                        relation.rel_type = rrel.value [i];
-                }
-                for (size_t i=0; i<rrel.ways.size (); i++)
-                    relation.ways.push_back (std::make_pair (rrel.ways [i],
-                                rrel.role_way [i]));
-                for (size_t i=0; i<rrel.nodes.size (); i++)
-                    relation.nodes.push_back (std::make_pair (rrel.nodes [i],
-                                rrel.role_node [i]));
-                m_relations.push_back (relation);
+                errors [bi] = e.what ();
             }
         }
-        else
+
+        for (size_t i = 0; i < static_cast <size_t> (nb); i++)
         {
-            traverseWays (it);
+            if (!errors [i].empty ())
+                throw std::runtime_error (errors [i]);
+            add_block (blocks [i]);
         }
     }
+} // end function XmlData::read_pbf
 
-} // end function XmlData::traverseWays
+inline void XmlData::add_block (RawBlock &block)
+{
+    for (auto &n: block.nodes)
+        add_node (n);
+    for (auto &w: block.ways)
+        add_way (w);
+    for (auto &r: block.relations)
+        add_relation (r);
+} // end function XmlData::add_block
 
 
 /************************************************************************
  ************************************************************************
  **                                                                    **
- **                     FUNCTION::TRAVERSERELATION                     **
+ **                          FUNCTION::ADD_NODE                        **
  **                                                                    **
  ************************************************************************
  ************************************************************************/
 
-inline void XmlData::traverseRelation (XmlNodePtr pt, RawRelation& rrel)
+inline void XmlData::add_node (RawNode &rnode)
 {
-    for (XmlAttrPtr it = pt->first_attribute (); it != nullptr;
-            it = it->next_attribute())
+    if (rnode.key.size () != rnode.value.size ())
+        throw std::runtime_error ("sizes of keys and values differ");
+
+    // Nodes outside a bounding polygon can only be part of objects which
+    // extend beyond it, and so are dropped when objects are trimmed
+    // exclusively. Otherwise they are retained, but not as points.
+    bool hidden = false;
+    if (m_opts.has_poly ())
     {
-        if (!strcmp (it->name(), "k"))
-            rrel.key.push_back (it->value());
-        else if (!strcmp (it->name(), "v"))
-            rrel.value.push_back (it->value());
-        else if (!strcmp (it->name(), "id"))
-            rrel.id = std::stoll(it->value());
-        else if (!strcmp (it->name(), "type"))
-            rrel.member_type = it->value ();
-        else if (!strcmp (it->name(), "ref"))
-        {
-            if (rrel.member_type == "node")
-                rrel.nodes.push_back (std::stoll (it->value ()));
-            else if (rrel.member_type == "way")
-                rrel.ways.push_back (std::stoll (it->value ()));
-            else if (rrel.member_type == "relation")
-                rrel.relations.push_back (std::stoll (it->value ()));
-            else
-                throw std::runtime_error ("unknown member_type");
-        } else if (!strcmp (it->name(), "role"))
-        {
-            if (rrel.member_type == "node")
-                rrel.role_node.push_back (it->value ());
-            else if (rrel.member_type == "way")
-                rrel.role_way.push_back (it->value ());
-            else if (rrel.member_type == "relation")
-                rrel.role_relation.push_back (it->value ());
-            else
-                throw std::runtime_error ("unknown member_type");
-            // Not all OSM Multipolygons have (key="type",
-            // value="multipolygon"): For example, (key="type",
-            // value="boundary") are often multipolygons. The things they all
-            // have are "inner" and "outer" roles.
-            if (!strcmp (it->value(), "inner") || !strcmp (it->value(), "outer"))
-                rrel.ispoly = true;
-        }
+        const int pip = point_in_polygon (rnode.lon, rnode.lat,
+                m_opts.poly_x, m_opts.poly_y);
+        if (m_opts.exclude && pip == 0)
+            return;
+        hidden = m_opts.exclude ? (pip != 1) : (pip == 0);
     }
-    // allows for >1 child nodes
-    for (XmlNodePtr it = pt->first_node(); it != nullptr; it = it->next_sibling())
+
+    // OSM IDs are sometimes duplicated, even though they ought not be. Only
+    // the first instance of any given ID is inserted.
+    if (m_nodes.find (rnode.id) == Nodes::npos)
     {
-        traverseRelation (it, rrel);
+        if (hidden)
+            m_hidden_nodes.insert (rnode.id);
+        if (rnode.lon < xmin) xmin = rnode.lon;
+        if (rnode.lon > xmax) xmax = rnode.lon;
+        if (rnode.lat < ymin) ymin = rnode.lat;
+        if (rnode.lat > ymax) ymax = rnode.lat;
+        intern_tags (rnode.key, rnode.value, m_node_kv);
+        m_nodes.add (rnode.id, rnode.lon, rnode.lat, m_node_kv);
     }
-} // end function XmlData::traverseRelation
+} // end function XmlData::add_node
 
 
 /************************************************************************
  ************************************************************************
  **                                                                    **
- **                        FUNCTION::TRAVERSEWAY                       **
+ **                          FUNCTION::ADD_WAY                         **
  **                                                                    **
  ************************************************************************
  ************************************************************************/
 
-inline void XmlData::traverseWay (XmlNodePtr pt, RawWay& rway)
+inline void XmlData::add_way (RawWay &rway)
 {
-    for (XmlAttrPtr it = pt->first_attribute (); it != nullptr;
-            it = it->next_attribute())
+    if (rway.key.size () != rway.value.size ())
+        throw std::runtime_error ("sizes of keys and values differ");
+
+    // Ways with any nodes outside a bounding polygon are dropped when trimmed
+    // exclusively. Otherwise ways entirely outside are retained only until
+    // it is known whether they are members of any retained relations.
+    bool hidden = false;
+    if (m_opts.has_poly ())
     {
-        if (!strcmp (it->name(), "k"))
-            rway.key.push_back (it->value());
-        else if (!strcmp (it->name(), "v"))
-            rway.value.push_back (it->value());
-        else if (!strcmp (it->name(), "id"))
-            rway.id = std::stoll(it->value());
-        else if (!strcmp (it->name(), "ref"))
-            rway.nodes.push_back (std::stoll(it->value()));
+        size_t n_in = 0;
+        for (auto n: rway.nodes)
+            if (node_in_poly (n))
+                n_in++;
+        if (m_opts.exclude && n_in < rway.nodes.size ())
+            return;
+        hidden = (n_in == 0);
     }
-    // allows for >1 child nodes
-    for (XmlNodePtr it = pt->first_node(); it != nullptr; it = it->next_sibling())
+
+    auto it = m_ways.lower_bound (rway.id);
+    if (it == m_ways.end () || it->first != rway.id)
     {
-        traverseWay (it, rway);
+        if (hidden)
+            m_hidden_ways.insert (rway.id);
+        OneWay way (&m_arena);
+        way.id = rway.id;
+        intern_tags (rway.key, rway.value, way.key_val);
+        way.nodes.assign (rway.nodes.begin (), rway.nodes.end ());
+        m_ways.emplace_hint (it, way.id, std::move (way));
     }
-} // end function XmlData::traverseWay
+} // end function XmlData::add_way
 
 
 /************************************************************************
  ************************************************************************
  **                                                                    **
- **                       FUNCTION::TRAVERSENODE                       **
+ **                       FUNCTION::ADD_RELATION                       **
  **                                                                    **
  ************************************************************************
  ************************************************************************/
 
-inline void XmlData::traverseNode (XmlNodePtr pt, RawNode& rnode)
+inline void XmlData::add_relation (RawRelation &rrel)
 {
-    for (XmlAttrPtr it = pt->first_attribute (); it != nullptr;
-            it = it->next_attribute())
+    if (rrel.key.size () != rrel.value.size ())
+        throw std::runtime_error ("sizes of keys and values differ");
+    if (rrel.ways.size () != rrel.role_way.size ())
+        throw std::runtime_error ("size of ways and roles differ");
+    if (rrel.nodes.size () != rrel.role_node.size ())
+        throw std::runtime_error ("size of nodes and roles differ");
+    if (rrel.relations.size () != rrel.role_relation.size ())
+        throw std::runtime_error ("size of relations and roles differ");
+
+    if (m_opts.has_poly ())
     {
-        if (!strcmp (it->name(), "id"))
-            rnode.id = std::stoll(it->value());
-        else if (!strcmp (it->name(), "lat"))
-            rnode.lat = std::stod(it->value());
-        else if (!strcmp (it->name(), "lon"))
-            rnode.lon = std::stod(it->value());
-        else if (!strcmp (it->name(), "k"))
-            rnode.key.push_back (it->value ());
-        else if (!strcmp (it->name(), "v"))
-            rnode.value.push_back (it->value ());
+        size_t n_in = 0;
+        for (auto w: rrel.ways)
+            if (m_ways.find (w) != m_ways.end () && !is_hidden_way (w))
+                n_in++;
+        for (auto n: rrel.nodes)
+            if (node_in_poly (n))
+                n_in++;
+        /* Relations with no node or way members, such as those whose members
+         * are only other relations, can not be located with respect to the
+         * polygon, and are always retained. */
+        const size_t n_memb = rrel.ways.size () + rrel.nodes.size ();
+        if (n_memb > 0 && ((m_opts.exclude && n_in < n_memb) ||
+                    (!m_opts.exclude && n_in == 0)))
+            return;
     }
-    // allows for >1 child nodes
-    for (XmlNodePtr it = pt->first_node(); it != nullptr; it = it->next_sibling())
+
+    auto rel_id = [this] (uint32_t i) { return m_relations [i].id; };
+    if (m_rel_index.find (rrel.id, rel_id) == IdIndex::npos)
+    {
+        Relation relation (&m_arena);
+        relation.id = rrel.id;
+        relation.ispoly = rrel.ispoly;
+        intern_tags (rrel.key, rrel.value, relation.key_val);
+        for (size_t i=0; i<rrel.key.size (); i++)
+            if (rrel.key [i] == "type")
+                relation.rel_type = rrel.value [i].str ();
+        relation.ways.reserve (rrel.ways.size ());
+        relation.nodes.reserve (rrel.nodes.size ());
+        relation.relations.reserve (rrel.relations.size ());
+        for (size_t i=0; i<rrel.ways.size (); i++)
+            relation.ways.push_back (std::make_pair (rrel.ways [i],
+                        rrel.role_way [i].str ()));
+        for (size_t i=0; i<rrel.nodes.size (); i++)
+            relation.nodes.push_back (std::make_pair (rrel.nodes [i],
+                        rrel.role_node [i].str ()));
+        for (size_t i=0; i<rrel.relations.size (); i++)
+            relation.relations.push_back (std::make_pair (rrel.relations [i],
+                        rrel.role_relation [i].str ()));
+        m_relations.push_back (std::move (relation));
+        m_rel_index.insert (m_relations.size () - 1, rel_id);
+    }
+} // end function XmlData::add_relation
+
+
+/************************************************************************
+ ************************************************************************
+ **                                                                    **
+ **                        FUNCTION::TRIM_TO_POLY                      **
+ **                                                                    **
+ ************************************************************************
+ ************************************************************************/
+
+// Whether a node lies within or on the boundary of the bounding polygon. This
+// is called while parsing, before m_nodes can be searched.
+inline bool XmlData::node_in_poly (osmid_t id) const
+{
+    if (m_nodes.find (id) == Nodes::npos)
+        return false;
+    // Only outside nodes are hidden when not trimming exclusively
+    return m_opts.exclude ||
+        m_hidden_nodes.find (id) == m_hidden_nodes.end ();
+}
+
+/* Remove hidden ways and nodes which are not part of any retained objects,
+ * and reduce the bbox to the remaining data. Hidden ways
+ * which remain are members of relations, and are not returned as lines or
+ * polygons. Hidden nodes which remain are likewise not returned as points,
+ * and are flagged in m_node_hidden rather than copying all other nodes.
+ */
+inline void XmlData::trim_to_poly ()
+{
+    std::unordered_set <osmid_t> rel_ways;
+    for (auto &r: m_relations)
+        for (auto &w: r.ways)
+            rel_ways.insert (w.first);
+
+    for (auto it = m_ways.begin (); it != m_ways.end (); )
+    {
+        if (is_hidden_way (it->first) &&
+                rel_ways.find (it->first) == rel_ways.end ())
+        {
+            m_hidden_ways.erase (it->first);
+            it = m_ways.erase (it);
+        } else
+            ++it;
+    }
+
+    std::unordered_set <osmid_t> way_nodes;
+    for (auto &w: m_ways)
+        way_nodes.insert (w.second.nodes.begin (), w.second.nodes.end ());
+
+    xmin = ymin = DOUBLE_MAX;
+    xmax = ymax = -DOUBLE_MAX;
+    std::vector <bool> keep (m_nodes.size (), true);
+    m_node_hidden.clear ();
+    m_node_hidden.reserve (m_nodes.size ());
+    m_n_hidden = 0;
+    for (size_t i = 0; i < m_nodes.size (); i++)
     {
-        traverseNode (it, rnode);
+        const osmid_t id = m_nodes.id (i);
+        const bool hidden = m_hidden_nodes.find (id) != m_hidden_nodes.end ();
+        if (hidden && way_nodes.find (id) == way_nodes.end ())
+        {
+            keep [i] = false;
+            continue;
+        }
+        if (m_nodes.lon (i) < xmin) xmin = m_nodes.lon (i);
+        if (m_nodes.lon (i) > xmax) xmax = m_nodes.lon (i);
+        if (m_nodes.lat (i) < ymin) ymin = m_nodes.lat (i);
+        if (m_nodes.lat (i) > ymax) ymax = m_nodes.lat (i);
+        // Positions after filtering, which retains the order of nodes
+        m_node_hidden.push_back (hidden);
+        if (hidden)
+            m_n_hidden++;
     }
-} // end function XmlData::traverseNode
+    m_nodes.filter (keep);
+    // Hidden ids are only needed while parsing
+    m_hidden_nodes.clear ();
+} // end function XmlData::trim_to_poly
+
 
+/************************************************************************
+ ************************************************************************
+ **                                                                    **
+ **                      FUNCTION::INDEX_WAY_NODES                     **
+ **                                                                    **
+ ************************************************************************
+ ************************************************************************/
+
+// Resolve the node ids of every way to positions in m_nodes, which must be
+// final. Ways are generally many fewer than nodes, and so are not sorted to
+// allow a merge.
+inline void XmlData::index_way_nodes ()
+{
+    if (m_nodes.size () >= MISSING_NODE)
+        throw std::runtime_error ("too many nodes to be indexed");
+
+    for (auto &w: m_ways)
+    {
+        OneWay &way = w.second;
+        way.node_index.resize (way.nodes.size ());
+        way.missing_nodes = false;
+        for (size_t i = 0; i < way.nodes.size (); i++)
+        {
+            const size_t j = m_nodes.find (way.nodes [i]);
+            if (j == Nodes::npos)
+            {
+                way.node_index [i] = MISSING_NODE;
+                way.missing_nodes = true;
+            } else
+                way.node_index [i] = static_cast <uint32_t> (j);
+        }
+    }
+} // end function XmlData::index_way_nodes
+
+
+/************************************************************************
+ ************************************************************************
+ **                                                                    **
+ **                        FUNCTION::INTERN_TAGS                       **
+ **                                                                    **
+ ************************************************************************
+ ************************************************************************/
+
+// Convert tags to dictionary ids, sorted by key, and retaining only the first
+// of any duplicated keys
+inline void XmlData::intern_tags (const std::vector <StrView> &key,
+        const std::vector <StrView> &value, KeyVals &kv)
+{
+    Dictionary &dict = m_unique.strings;
+    kv.clear ();
+    kv.reserve (key.size ());
+    for (size_t i = 0; i < key.size (); i++)
+        kv.push_back (std::make_pair (dict.id (key [i]), dict.id (value [i])));
+
+    std::stable_sort (kv.begin (), kv.end (),
+            [&dict] (const std::pair <uint32_t, uint32_t> &a,
+                const std::pair <uint32_t, uint32_t> &b)
+            { return dict.str (a.first) < dict.str (b.first); });
+    kv.erase (std::unique (kv.begin (), kv.end (),
+                [] (const std::pair <uint32_t, uint32_t> &a,
+                    const std::pair <uint32_t, uint32_t> &b)
+                { return a.first == b.first; }), kv.end ());
+}
+
+// Collect the keys of points, (non-hidden) ways, and relations, which provide
+// the alphabetically ordered columns of the key-val matrices, and index the
+// column of each key by its dictionary id
 inline void XmlData::make_key_val_indices ()
 {
-    // These are std::maps which enable keys to be mapped directly onto their
-    // column number in the key-val matrices
-    unsigned int i = 0;
-    for (auto m: m_unique.k_point)
-        m_unique.k_point_index.insert (std::make_pair (m, i++));
-
-    i = 0;
-    for (auto m: m_unique.k_way)
-        m_unique.k_way_index.insert (std::make_pair (m, i++));
-
-    i = 0;
-    for (auto m: m_unique.k_rel)
-        m_unique.k_rel_index.insert (std::make_pair (m, i++));
+    const size_t n = m_unique.strings.size ();
+    std::vector <bool> is_point (n, false), is_way (n, false),
+        is_rel (n, false);
+
+    for (size_t i = 0; i < m_nodes.size (); i++)
+        if (!is_hidden_node (i))
+            for (size_t j = m_nodes.kv_begin (i); j < m_nodes.kv_end (i); j++)
+                is_point [m_nodes.key (j)] = true;
+    for (auto &w: m_ways)
+        if (!is_hidden_way (w.first))
+            for (auto &kv: w.second.key_val)
+                is_way [kv.first] = true;
+    for (auto &r: m_relations)
+        for (auto &kv: r.key_val)
+            is_rel [kv.first] = true;
+
+    const Dictionary &dict = m_unique.strings;
+    auto index_keys = [&dict, n] (const std::vector <bool> &is_key,
+            std::set <std::string> &keys, std::vector <unsigned int> &index)
+    {
+        std::vector <uint32_t> ids;
+        for (uint32_t i = 0; i < n; i++)
+            if (is_key [i])
+                ids.push_back (i);
+        std::sort (ids.begin (), ids.end (), [&dict] (uint32_t a, uint32_t b)
+                { return dict.str (a) < dict.str (b); });
+
+        keys.clear ();
+        index.assign (n, 0);
+        unsigned int col = 0;
+        for (auto i: ids)
+        {
+            keys.insert (keys.end (), dict.str (i));
+            index [i] = col++;
+        }
+    };
+    index_keys (is_point, m_unique.k_point, m_unique.k_point_index);
+    index_keys (is_way, m_unique.k_way, m_unique.k_way_index);
+    index_keys (is_rel, m_unique.k_rel, m_unique.k_rel_index);
 }
 
 /*---------------------------- fn headers -----------------------------*/
@@ -419,46 +1020,65 @@ inline void XmlData::make_key_val_indices ()
 namespace osm_sf {
 
 Rcpp::List get_osm_relations (const Relations &rels, 
-        const std::map <osmid_t, Node> &nodes,
-        const std::map <osmid_t, OneWay> &ways, const UniqueVals &unique_vals,
-        const Rcpp::NumericVector &bbox, const Rcpp::List &crs);
+        const Nodes &nodes,
+        const Ways &ways, const UniqueVals &unique_vals,
+        const Rcpp::NumericVector &bbox, const Rcpp::List &crs,
+        const bool merge_lines);
 void get_osm_ways (Rcpp::List &wayList, Rcpp::DataFrame &kv_df,
         const std::set <osmid_t> &way_ids, const Ways &ways, const Nodes &nodes,
         const UniqueVals &unique_vals, const std::string &geom_type,
         const Rcpp::NumericVector &bbox, const Rcpp::List &crs);
 void get_osm_nodes (Rcpp::List &ptList, Rcpp::DataFrame &kv_df,
-        const Nodes &nodes, const UniqueVals &unique_vals, 
+        const Nodes &nodes, const std::vector <bool> &hidden,
+        const UniqueVals &unique_vals, 
         const Rcpp::NumericVector &bbox, const Rcpp::List &crs);
 
+Rcpp::List get_osmdata (const XmlData &xml);
+
 } // end namespace osm_sf
 
 Rcpp::List rcpp_osmdata_sf (const std::string& st);
+Rcpp::List rcpp_osmdata_sf_file (const std::string& filename);
 
 namespace osm_sp {
 
-void get_osm_nodes (Rcpp::S4 &sp_points, const Nodes &nodes, 
-        const UniqueVals &unique_vals);
+void get_osm_nodes (Rcpp::S4 &sp_points, const Nodes &nodes,
+        const std::vector <bool> &hidden, const UniqueVals &unique_vals);
 void get_osm_ways (Rcpp::S4 &sp_ways, 
         const std::set <osmid_t> &way_ids, const Ways &ways, const Nodes &nodes,
         const UniqueVals &unique_vals, const std::string &geom_type);
 void get_osm_relations (Rcpp::S4 &multilines, Rcpp::S4 &multipolygons, 
-        const Relations &rels, const std::map <osmid_t, Node> &nodes,
-        const std::map <osmid_t, OneWay> &ways, const UniqueVals &unique_vals);
+        const Relations &rels, const Nodes &nodes,
+        const Ways &ways, const UniqueVals &unique_vals,
+        const bool merge_lines);
+
+Rcpp::List get_osmdata (const XmlData &xml);
 
 } // end namespace osm_sp
 
 Rcpp::List rcpp_osmdata_sp (const std::string& st);
+Rcpp::List rcpp_osmdata_sp_file (const std::string& filename);
 
 namespace osm_sc {
 
+// Templated on the type of identifiers, either std::string or osmid_t
+template <typename Id>
 void get_osm_relations (Rcpp::DataFrame &rel_df, Rcpp::DataFrame &kv_df,
-        const Relations &rels);
+        const Relations &rels, const Dictionary &dict);
+template <typename Id>
 void get_osm_ways (Rcpp::DataFrame &edge,
         Rcpp::DataFrame &object_link_edge, Rcpp::DataFrame &kv_df,
-        const Ways &ways);
+        const XmlData &xml);
+template <typename Id>
 void get_osm_nodes (Rcpp::DataFrame &node_df, Rcpp::DataFrame &kv_df,
-        const Nodes &nodes);
+        const XmlData &xml);
+Rcpp::List collate_sc (const Rcpp::DataFrame &vertex,
+        const Rcpp::DataFrame &edge, const Rcpp::DataFrame &oXe,
+        const Rcpp::DataFrame &obj_node, const Rcpp::DataFrame &obj_way,
+        const Rcpp::DataFrame &obj_rel_memb, const Rcpp::DataFrame &obj_rel_kv,
+        const Rcpp::List &way_membs, const Rcpp::List &rel_membs,
+        const Rcpp::CharacterVector &meta);
+template <typename Id>
+Rcpp::List get_osmdata (const XmlData &xml);
 
 } // end namespace osm_sc
-
-Rcpp::List rcpp_osmdata_sc (const std::string& st);
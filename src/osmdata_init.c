@@ -8,14 +8,34 @@
 */
 
 /* .Call calls */
-extern SEXP _osmdata_rcpp_osmdata_sc(SEXP);
-extern SEXP _osmdata_rcpp_osmdata_sf(SEXP);
-extern SEXP _osmdata_rcpp_osmdata_sp(SEXP);
+extern SEXP _osmdata_rcpp_osmdata_handle_info(SEXP);
+extern SEXP _osmdata_rcpp_osmdata_handle_sc(SEXP, SEXP);
+extern SEXP _osmdata_rcpp_osmdata_handle_sf(SEXP);
+extern SEXP _osmdata_rcpp_osmdata_handle_sp(SEXP);
+extern SEXP _osmdata_rcpp_osmdata_parse(SEXP, SEXP);
+extern SEXP _osmdata_rcpp_osmdata_parse_file(SEXP, SEXP);
+extern SEXP _osmdata_rcpp_osmdata_sc(SEXP, SEXP);
+extern SEXP _osmdata_rcpp_osmdata_sc_file(SEXP, SEXP);
+extern SEXP _osmdata_rcpp_osmdata_sf(SEXP, SEXP);
+extern SEXP _osmdata_rcpp_osmdata_sf_file(SEXP, SEXP);
+extern SEXP _osmdata_rcpp_osmdata_sp(SEXP, SEXP);
+extern SEXP _osmdata_rcpp_osmdata_sp_file(SEXP, SEXP);
+extern SEXP _osmdata_rcpp_test_parse_num(SEXP, SEXP);
 
 static const R_CallMethodDef CallEntries[] = {
-    {"_osmdata_rcpp_osmdata_sc", (DL_FUNC) &_osmdata_rcpp_osmdata_sc, 1},
-    {"_osmdata_rcpp_osmdata_sf", (DL_FUNC) &_osmdata_rcpp_osmdata_sf, 1},
-    {"_osmdata_rcpp_osmdata_sp", (DL_FUNC) &_osmdata_rcpp_osmdata_sp, 1},
+    {"_osmdata_rcpp_osmdata_handle_info", (DL_FUNC) &_osmdata_rcpp_osmdata_handle_info, 1},
+    {"_osmdata_rcpp_osmdata_handle_sc", (DL_FUNC) &_osmdata_rcpp_osmdata_handle_sc, 2},
+    {"_osmdata_rcpp_osmdata_handle_sf", (DL_FUNC) &_osmdata_rcpp_osmdata_handle_sf, 1},
+    {"_osmdata_rcpp_osmdata_handle_sp", (DL_FUNC) &_osmdata_rcpp_osmdata_handle_sp, 1},
+    {"_osmdata_rcpp_osmdata_parse", (DL_FUNC) &_osmdata_rcpp_osmdata_parse, 2},
+    {"_osmdata_rcpp_osmdata_parse_file", (DL_FUNC) &_osmdata_rcpp_osmdata_parse_file, 2},
+    {"_osmdata_rcpp_osmdata_sc", (DL_FUNC) &_osmdata_rcpp_osmdata_sc, 2},
+    {"_osmdata_rcpp_osmdata_sc_file", (DL_FUNC) &_osmdata_rcpp_osmdata_sc_file, 2},
+    {"_osmdata_rcpp_osmdata_sf", (DL_FUNC) &_osmdata_rcpp_osmdata_sf, 2},
+    {"_osmdata_rcpp_osmdata_sf_file", (DL_FUNC) &_osmdata_rcpp_osmdata_sf_file, 2},
+    {"_osmdata_rcpp_osmdata_sp", (DL_FUNC) &_osmdata_rcpp_osmdata_sp, 2},
+    {"_osmdata_rcpp_osmdata_sp_file", (DL_FUNC) &_osmdata_rcpp_osmdata_sp_file, 2},
+    {"_osmdata_rcpp_test_parse_num", (DL_FUNC) &_osmdata_rcpp_test_parse_num, 2},
     {NULL, NULL, 0}
 };
 
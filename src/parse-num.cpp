@@ -0,0 +1,72 @@
+/***************************************************************************
+ *  Project:    osmdata
+ *  File:       parse-num.cpp
+ *  Language:   C++
+ *
+ *  osmdata is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  osmdata is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along with
+ *  osm-router.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Author:     Mark Padgham
+ *  E-Mail:     mark.padgham@email.com
+ *
+ *  Description:    Exposes the numeric parsers of parse-num.h to R, solely so
+ *                  that they can be tested against strtod/strtoll.
+ *
+ *  Limitations:
+ *
+ *  Dependencies:       none
+ *
+ *  Compiler Options:   -std=c++11
+ ***************************************************************************/
+
+#include "parse-num.h"
+
+#include <Rcpp.h>
+
+#include <cstdlib>
+
+//' rcpp_test_parse_num
+//'
+//' Parse each string both with the fast parsers used for OSM XML attributes,
+//' and with the standard library functions they replace.
+//'
+//' @param x Character vector of numeric strings
+//' @param integer If TRUE, parse as integer ids, otherwise as decimals.
+//' @return List of two numeric vectors, 'fast' and 'std', which should be
+//' identical.
+//'
+//' @noRd
+// [[Rcpp::export]]
+Rcpp::List rcpp_test_parse_num (const std::vector <std::string> &x,
+        bool integer)
+{
+    const size_t n = x.size ();
+    Rcpp::NumericVector fast (n), ref (n);
+    for (size_t i = 0; i < n; i++)
+    {
+        const char * s = x [i].c_str ();
+        if (integer)
+        {
+            fast [i] = static_cast <double> (
+                    parse_num::parse_integer (s, x [i].size ()));
+            ref [i] = static_cast <double> (strtoll (s, nullptr, 10));
+        } else
+        {
+            fast [i] = parse_num::parse_double (s, x [i].size ());
+            ref [i] = strtod (s, nullptr);
+        }
+    }
+
+    return Rcpp::List::create (Rcpp::Named ("fast") = fast,
+            Rcpp::Named ("std") = ref);
+}
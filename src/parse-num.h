@@ -0,0 +1,164 @@
+/***************************************************************************
+ *  Project:    osmdata
+ *  File:       parse-num.h
+ *  Language:   C++
+ *
+ *  osmdata is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  osmdata is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along with
+ *  osm-router.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Author:     Mark Padgham
+ *  E-Mail:     mark.padgham@email.com
+ *
+ *  Description:    Allocation- and locale-free parsing of OSM ids and
+ *                  coordinates directly from (non-terminated) attribute
+ *                  values.
+ *
+ *  Limitations:    Only plain fixed-format decimals are parsed directly; all
+ *                  other forms (exponents, more than 15 significant digits,
+ *                  inf/nan) are passed on to strtod, and so give the same
+ *                  results as std::stod.
+ *
+ *  Dependencies:       none
+ *
+ *  Compiler Options:   -std=c++11
+ ***************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <cstdlib>
+#include <cerrno>
+#include <stdexcept>
+
+namespace parse_num {
+
+// Integer ids with more digits than this may overflow, and are passed to
+// strtoll.
+constexpr size_t MAX_ID_DIGITS = 18;
+// Any integer mantissa of up to 15 digits is exactly representable as a
+// double, as is any power of ten up to 1e22.
+constexpr size_t MAX_MANTISSA_DIGITS = 15;
+constexpr size_t MAX_POW10 = 22;
+constexpr double pow10 [] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+inline bool is_digit (char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+inline bool is_space (char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Fallbacks for anything not in the plain format. These copy the value to
+// obtain a terminated string, and so are only used for atypical values.
+inline long long slow_integer (const char * s, size_t len)
+{
+    const std::string str (s, len);
+    char * end;
+    errno = 0;
+    const long long res = strtoll (str.c_str (), &end, 10);
+    if (end == str.c_str ())
+        throw std::runtime_error ("invalid integer value: " + str);
+    if (errno == ERANGE)
+        throw std::runtime_error ("integer value out of range: " + str);
+    return res;
+}
+
+inline double slow_double (const char * s, size_t len)
+{
+    const std::string str (s, len);
+    char * end;
+    const double res = strtod (str.c_str (), &end);
+    if (end == str.c_str ())
+        throw std::runtime_error ("invalid numeric value: " + str);
+    return res;
+}
+
+/* Parse a signed decimal integer, as std::stoll but without allocating or
+ * consulting the locale. As with std::stoll, leading white space is skipped
+ * and parsing stops at the first non-digit. */
+inline long long parse_integer (const char * s, size_t len)
+{
+    const char * p = s, * end = s + len;
+    while (p < end && is_space (*p))
+        p++;
+    bool neg = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        neg = (*p++ == '-');
+
+    const char * digits = p;
+    unsigned long long res = 0;
+    while (p < end && is_digit (*p))
+        res = res * 10 + static_cast <unsigned long long> (*p++ - '0');
+
+    const size_t ndigits = static_cast <size_t> (p - digits);
+    if (ndigits == 0 || ndigits > MAX_ID_DIGITS)
+        return slow_integer (s, len);
+
+    return neg ? -static_cast <long long> (res) : static_cast <long long> (res);
+}
+
+/* Parse a fixed-format decimal such as "-33.8674869". Mantissas of up to 15
+ * digits are converted exactly to double, and then divided by an exact power
+ * of ten. A single IEEE division is correctly rounded, so results are
+ * identical to those of strtod. */
+inline double parse_double (const char * s, size_t len)
+{
+    const char * p = s, * end = s + len;
+    while (p < end && is_space (*p))
+        p++;
+    bool neg = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        neg = (*p++ == '-');
+
+    unsigned long long mantissa = 0;
+    size_t ndigits = 0, nfrac = 0;
+    bool any_digits = false;
+    while (p < end && is_digit (*p))
+    {
+        mantissa = mantissa * 10 + static_cast <unsigned long long> (*p++ - '0');
+        if (mantissa > 0)
+            ndigits++; // leading zeros are not significant
+        any_digits = true;
+    }
+    if (p < end && *p == '.')
+    {
+        p++;
+        while (p < end && is_digit (*p))
+        {
+            mantissa = mantissa * 10 +
+                static_cast <unsigned long long> (*p++ - '0');
+            if (mantissa > 0)
+                ndigits++;
+            nfrac++;
+            any_digits = true;
+        }
+    }
+
+    // Exponents, hex, "inf", "nan", and anything too long to be exact
+    if (!any_digits || ndigits > MAX_MANTISSA_DIGITS || nfrac > MAX_POW10 ||
+            (p < end && (*p == 'e' || *p == 'E' || *p == 'x' || *p == 'X')))
+        return slow_double (s, len);
+
+    double res = static_cast <double> (mantissa);
+    if (nfrac > 0)
+        res /= pow10 [nfrac];
+
+    return neg ? -res : res;
+}
+
+} // end namespace parse_num
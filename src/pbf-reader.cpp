@@ -0,0 +1,595 @@
+/***************************************************************************
+ *  Project:    osmdata
+ *  File:       pbf-reader.cpp
+ *  Language:   C++
+ *
+ *  osmdata is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  osmdata is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along with
+ *  osm-router.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Author:     Mark Padgham
+ *  E-Mail:     mark.padgham@email.com
+ *
+ *  Description:    Decoder for the OSM PBF format
+ *                  (https://wiki.openstreetmap.org/wiki/PBF_Format), producing
+ *                  the same RawNode/RawWay/RawRelation structures that are
+ *                  read from OSM XML.
+ *
+ *  Limitations:    Only uncompressed and zlib-compressed blobs are supported.
+ *                  Element metadata (Info/DenseInfo) are not read.
+ *
+ *  Dependencies:       zlib
+ *
+ *  Compiler Options:   -std=c++11
+ ***************************************************************************/
+
+#include "pbf-reader.h"
+
+#include <zlib.h>
+
+#include <ctime>
+
+namespace {
+
+// Maximal sizes given in the PBF specification
+constexpr size_t MAX_BLOB_HEADER_SIZE = 64 * 1024;
+constexpr size_t MAX_BLOB_SIZE = 32 * 1024 * 1024;
+
+// Strings are held as views into the decompressed block, which are also
+// passed on to elements, and only copied when interned. Whether each string
+// is a key to be retained is determined once for the whole table, rather than
+// for each tag.
+class StringTable
+{
+    private:
+
+        std::vector <std::pair <const char *, size_t> > m_strings;
+        std::vector <char> m_keep;
+
+    public:
+
+        void read (pbf::ProtoReader pr, const ParseOptions &opts)
+        {
+            m_strings.clear ();
+            while (pr.next ())
+            {
+                if (pr.tag () == 1)
+                {
+                    const char * data;
+                    size_t len;
+                    pr.bytes (data, len);
+                    m_strings.push_back (std::make_pair (data, len));
+                } else
+                    pr.skip ();
+            }
+
+            m_keep.assign (m_strings.size (), 1);
+            if (!opts.keys.empty ())
+                for (size_t i = 0; i < m_strings.size (); i++)
+                    m_keep [i] = opts.keep_key (StrView (
+                                m_strings [i].first, m_strings [i].second));
+        }
+
+        bool keep (uint64_t i) const
+        {
+            if (i >= m_keep.size ())
+                throw std::runtime_error ("PBF string index out of range");
+            return m_keep [i];
+        }
+
+        StrView at (uint64_t i) const
+        {
+            if (i >= m_strings.size ())
+                throw std::runtime_error ("PBF string index out of range");
+            return StrView (m_strings [i].first, m_strings [i].second);
+        }
+
+        bool equals (uint64_t i, const char * str) const
+        {
+            if (i >= m_strings.size ())
+                throw std::runtime_error ("PBF string index out of range");
+            return strlen (str) == m_strings [i].second &&
+                !strncmp (m_strings [i].first, str, m_strings [i].second);
+        }
+};
+
+// Coordinate encoding of one PrimitiveBlock
+struct Granularity
+{
+    int64_t granularity = 100;
+    int64_t lat_offset = 0, lon_offset = 0;
+
+    /* Coordinates are first converted to integer nanodegrees, and then
+     * divided by an exact power of ten. This gives results identical to
+     * strtod of the corresponding decimal strings of OSM XML. */
+    double lat (int64_t x) const
+    {
+        return static_cast <double> (lat_offset + granularity * x) / 1e9;
+    }
+    double lon (int64_t x) const
+    {
+        return static_cast <double> (lon_offset + granularity * x) / 1e9;
+    }
+};
+
+/* Repeated scalar fields are generally packed, but must also be accepted
+ * when unpacked. Delta-coded fields are accumulated as they are read, so
+ * that `out` holds absolute values. */
+void read_uint (pbf::ProtoReader &pr, std::vector <uint64_t> &out)
+{
+    if (pr.wire_type () == 2)
+    {
+        pbf::ProtoReader p = pr.message ();
+        while (!p.at_end ())
+            out.push_back (p.varint ());
+    } else
+        out.push_back (pr.varint ());
+}
+
+template <typename T>
+void read_sint_delta (pbf::ProtoReader &pr, std::vector <T> &out)
+{
+    T val = out.empty () ? 0 : out.back ();
+    if (pr.wire_type () == 2)
+    {
+        pbf::ProtoReader p = pr.message ();
+        while (!p.at_end ())
+        {
+            val += p.sint64 ();
+            out.push_back (val);
+        }
+    } else
+        out.push_back (val + pr.sint64 ());
+}
+
+void read_tags (const std::vector <uint64_t> &keys,
+        const std::vector <uint64_t> &vals, const StringTable &st,
+        std::vector <StrView> &key_out, std::vector <StrView> &val_out)
+{
+    if (keys.size () != vals.size ())
+        throw std::runtime_error ("sizes of keys and values differ");
+    key_out.reserve (keys.size ());
+    val_out.reserve (vals.size ());
+    for (size_t i = 0; i < keys.size (); i++)
+    {
+        if (!st.keep (keys [i]))
+            continue;
+        key_out.push_back (st.at (keys [i]));
+        val_out.push_back (st.at (vals [i]));
+    }
+}
+
+} // end anonymous namespace
+
+
+/************************************************************************
+ ************************************************************************
+ **                                                                    **
+ **                        FUNCTION::SPLIT_BLOBS                       **
+ **                                                                    **
+ ************************************************************************
+ ************************************************************************/
+
+// A PBF file starts with the 4-byte length of a BlobHeader, the first field of
+// which is the string "OSMHeader"
+bool pbf::is_pbf (const char * begin, const char * end)
+{
+    const char * hdr = "\x0A\x09OSMHeader";
+    return end - begin >= 15 && !memcmp (begin + 4, hdr, 11);
+}
+
+std::vector <pbf::BlobRef> pbf::split_blobs (const char * begin,
+        const char * end)
+{
+    std::vector <BlobRef> blobs;
+    const unsigned char * p = reinterpret_cast <const unsigned char *> (begin);
+    const unsigned char * pend = reinterpret_cast <const unsigned char *> (end);
+    while (p < pend)
+    {
+        if (pend - p < 4)
+            throw std::runtime_error ("truncated PBF file");
+        const size_t hlen = (static_cast <size_t> (p [0]) << 24) |
+            (static_cast <size_t> (p [1]) << 16) |
+            (static_cast <size_t> (p [2]) << 8) | static_cast <size_t> (p [3]);
+        p += 4;
+        if (hlen > MAX_BLOB_HEADER_SIZE ||
+                hlen > static_cast <size_t> (pend - p))
+            throw std::runtime_error ("corrupt PBF BlobHeader");
+
+        ProtoReader pr (reinterpret_cast <const char *> (p), hlen);
+        std::string type;
+        uint64_t datasize = 0;
+        while (pr.next ())
+        {
+            if (pr.tag () == 1)
+                type = pr.string ();
+            else if (pr.tag () == 3)
+                datasize = pr.varint ();
+            else
+                pr.skip ();
+        }
+        p += hlen;
+        if (datasize > MAX_BLOB_SIZE ||
+                datasize > static_cast <uint64_t> (pend - p))
+            throw std::runtime_error ("corrupt PBF Blob");
+
+        // Blobs of unknown type are to be skipped
+        if (type == "OSMHeader" || type == "OSMData")
+        {
+            BlobRef b;
+            b.is_header = (type == "OSMHeader");
+            b.data = reinterpret_cast <const char *> (p);
+            b.size = static_cast <size_t> (datasize);
+            blobs.push_back (b);
+        }
+        p += datasize;
+    }
+    return blobs;
+}
+
+
+/************************************************************************
+ ************************************************************************
+ **                                                                    **
+ **                         FUNCTION::BLOB_DATA                        **
+ **                                                                    **
+ ************************************************************************
+ ************************************************************************/
+
+// Sets data and len to the payload of the blob, inflating into buf if
+// necessary, so buf must outlive any use of data.
+void pbf::blob_data (const BlobRef &blob, std::vector <char> &buf,
+        const char * &data, size_t &len)
+{
+    ProtoReader pr (blob.data, blob.size);
+    const char * zdata = nullptr;
+    size_t zlen = 0;
+    uint64_t raw_size = 0;
+    while (pr.next ())
+    {
+        switch (pr.tag ())
+        {
+            case 1: // raw
+                pr.bytes (data, len);
+                return;
+            case 2:
+                raw_size = pr.varint ();
+                break;
+            case 3:
+                pr.bytes (zdata, zlen);
+                break;
+            case 4: case 5: case 6: case 7:
+                throw std::runtime_error (
+                        "PBF compression other than zlib is not supported");
+            default:
+                pr.skip ();
+        }
+    }
+    if (zdata == nullptr || raw_size > MAX_BLOB_SIZE)
+        throw std::runtime_error ("corrupt PBF Blob");
+
+    buf.resize (static_cast <size_t> (raw_size));
+    uLongf dest_len = static_cast <uLongf> (raw_size);
+    const int res = uncompress (reinterpret_cast <Bytef *> (buf.data ()),
+            &dest_len, reinterpret_cast <const Bytef *> (zdata),
+            static_cast <uLong> (zlen));
+    if (res != Z_OK || dest_len != raw_size)
+        throw std::runtime_error ("PBF Blob could not be decompressed");
+    data = buf.data ();
+    len = static_cast <size_t> (raw_size);
+}
+
+
+/************************************************************************
+ ************************************************************************
+ **                                                                    **
+ **                       FUNCTION::DECODE_HEADER                      **
+ **                                                                    **
+ ************************************************************************
+ ************************************************************************/
+
+/* The HeaderBlock is the PBF equivalent of the <osm> and <meta> elements:
+ * writingprogram is used as the generator, and the replication timestamp is
+ * formatted as an Overpass osm_base timestamp. */
+void pbf::decode_header (const char * data, size_t len, OsmMeta &meta)
+{
+    ProtoReader pr (data, len);
+    while (pr.next ())
+    {
+        switch (pr.tag ())
+        {
+            case 4: // required_features
+                {
+                    const std::string feature = pr.string ();
+                    if (feature == "OsmSchema-V0.6")
+                        meta.osm_version = "0.6";
+                    else if (feature != "DenseNodes")
+                        throw std::runtime_error ("PBF feature " + feature +
+                                " is not supported");
+                    break;
+                }
+            case 16: // writingprogram
+                meta.generator = pr.string ();
+                break;
+            case 32: // osmosis_replication_timestamp
+                {
+                    const time_t t = static_cast <time_t> (pr.int64 ());
+                    char buf [32];
+                    const struct tm * tm = gmtime (&t);
+                    if (tm != nullptr && strftime (buf, sizeof (buf),
+                                "%Y-%m-%dT%H:%M:%SZ", tm) > 0)
+                        meta.timestamp = buf;
+                    break;
+                }
+            default:
+                pr.skip ();
+        }
+    }
+}
+
+
+/************************************************************************
+ ************************************************************************
+ **                                                                    **
+ **                       FUNCTION::DECODE_BLOCK                       **
+ **                                                                    **
+ ************************************************************************
+ ************************************************************************/
+
+namespace {
+
+void decode_node (pbf::ProtoReader pr, const StringTable &st,
+        const Granularity &gran, std::vector <RawNode> &nodes)
+{
+    RawNode node;
+    std::vector <uint64_t> keys, vals;
+    int64_t lat = 0, lon = 0;
+    while (pr.next ())
+    {
+        switch (pr.tag ())
+        {
+            case 1:
+                node.id = pr.sint64 ();
+                break;
+            case 2:
+                read_uint (pr, keys);
+                break;
+            case 3:
+                read_uint (pr, vals);
+                break;
+            case 8:
+                lat = pr.sint64 ();
+                break;
+            case 9:
+                lon = pr.sint64 ();
+                break;
+            default:
+                pr.skip ();
+        }
+    }
+    node.lat = gran.lat (lat);
+    node.lon = gran.lon (lon);
+    read_tags (keys, vals, st, node.key, node.value);
+    nodes.push_back (std::move (node));
+}
+
+/* DenseNodes hold parallel delta-coded arrays of ids and coordinates, which
+ * are decoded in full before any nodes are constructed. Tags of all nodes are
+ * held in the single keys_vals array, with those of each node terminated by
+ * a zero. */
+void decode_dense (pbf::ProtoReader pr, const StringTable &st,
+        const Granularity &gran, std::vector <RawNode> &nodes)
+{
+    std::vector <osmid_t> ids;
+    std::vector <int64_t> lats, lons;
+    std::vector <uint64_t> keys_vals;
+    while (pr.next ())
+    {
+        switch (pr.tag ())
+        {
+            case 1:
+                read_sint_delta (pr, ids);
+                break;
+            case 8:
+                read_sint_delta (pr, lats);
+                break;
+            case 9:
+                read_sint_delta (pr, lons);
+                break;
+            case 10:
+                read_uint (pr, keys_vals);
+                break;
+            default:
+                pr.skip ();
+        }
+    }
+    if (lats.size () != ids.size () || lons.size () != ids.size ())
+        throw std::runtime_error ("inconsistent PBF DenseNodes");
+
+    const size_t n0 = nodes.size ();
+    nodes.resize (n0 + ids.size ());
+    size_t kv = 0;
+    for (size_t i = 0; i < ids.size (); i++)
+    {
+        RawNode &node = nodes [n0 + i];
+        node.id = ids [i];
+        node.lat = gran.lat (lats [i]);
+        node.lon = gran.lon (lons [i]);
+        while (kv < keys_vals.size () && keys_vals [kv] != 0)
+        {
+            if (kv + 1 >= keys_vals.size ())
+                throw std::runtime_error ("inconsistent PBF DenseNodes");
+            if (st.keep (keys_vals [kv]))
+            {
+                node.key.push_back (st.at (keys_vals [kv]));
+                node.value.push_back (st.at (keys_vals [kv + 1]));
+            }
+            kv += 2;
+        }
+        kv++; // skip the terminating zero
+    }
+}
+
+void decode_way (pbf::ProtoReader pr, const StringTable &st,
+        std::vector <RawWay> &ways)
+{
+    RawWay way;
+    std::vector <uint64_t> keys, vals;
+    while (pr.next ())
+    {
+        switch (pr.tag ())
+        {
+            case 1:
+                way.id = pr.int64 ();
+                break;
+            case 2:
+                read_uint (pr, keys);
+                break;
+            case 3:
+                read_uint (pr, vals);
+                break;
+            case 8:
+                read_sint_delta (pr, way.nodes);
+                break;
+            default:
+                pr.skip ();
+        }
+    }
+    read_tags (keys, vals, st, way.key, way.value);
+    ways.push_back (std::move (way));
+}
+
+void decode_relation (pbf::ProtoReader pr, const StringTable &st,
+        std::vector <RawRelation> &relations)
+{
+    RawRelation rel;
+    rel.ispoly = false;
+    std::vector <uint64_t> keys, vals, roles, types;
+    std::vector <osmid_t> memids;
+    while (pr.next ())
+    {
+        switch (pr.tag ())
+        {
+            case 1:
+                rel.id = pr.int64 ();
+                break;
+            case 2:
+                read_uint (pr, keys);
+                break;
+            case 3:
+                read_uint (pr, vals);
+                break;
+            case 8:
+                read_uint (pr, roles);
+                break;
+            case 9:
+                read_sint_delta (pr, memids);
+                break;
+            case 10:
+                read_uint (pr, types);
+                break;
+            default:
+                pr.skip ();
+        }
+    }
+    if (roles.size () != memids.size () || types.size () != memids.size ())
+        throw std::runtime_error ("inconsistent PBF relation members");
+
+    read_tags (keys, vals, st, rel.key, rel.value);
+    for (size_t i = 0; i < memids.size (); i++)
+    {
+        if (types [i] == 0)
+        {
+            rel.nodes.push_back (memids [i]);
+            rel.role_node.push_back (st.at (roles [i]));
+        } else if (types [i] == 1)
+        {
+            rel.ways.push_back (memids [i]);
+            rel.role_way.push_back (st.at (roles [i]));
+        } else if (types [i] == 2)
+        {
+            rel.relations.push_back (memids [i]);
+            rel.role_relation.push_back (st.at (roles [i]));
+        } else
+            throw std::runtime_error ("unknown member_type");
+        // As for XML, multipolygons are identified by their roles
+        if (st.equals (roles [i], "inner") || st.equals (roles [i], "outer"))
+            rel.ispoly = true;
+    }
+    relations.push_back (std::move (rel));
+}
+
+void decode_group (pbf::ProtoReader pr, const StringTable &st,
+        const Granularity &gran, RawBlock &block)
+{
+    while (pr.next ())
+    {
+        switch (pr.tag ())
+        {
+            case 1:
+                decode_node (pr.message (), st, gran, block.nodes);
+                break;
+            case 2:
+                decode_dense (pr.message (), st, gran, block.nodes);
+                break;
+            case 3:
+                decode_way (pr.message (), st, block.ways);
+                break;
+            case 4:
+                decode_relation (pr.message (), st, block.relations);
+                break;
+            default: // changesets
+                pr.skip ();
+        }
+    }
+}
+
+} // end anonymous namespace
+
+void pbf::decode_block (const char * data, size_t len, RawBlock &block,
+        const ParseOptions &opts)
+{
+    block.clear ();
+
+    // The granularity and offsets follow the primitive groups, so groups can
+    // only be decoded once the whole block has been scanned.
+    StringTable st;
+    Granularity gran;
+    std::vector <ProtoReader> groups;
+    ProtoReader pr (data, len);
+    while (pr.next ())
+    {
+        switch (pr.tag ())
+        {
+            case 1:
+                st.read (pr.message (), opts);
+                break;
+            case 2:
+                groups.push_back (pr.message ());
+                break;
+            case 17:
+                gran.granularity = pr.int64 ();
+                break;
+            case 19:
+                gran.lat_offset = pr.int64 ();
+                break;
+            case 20:
+                gran.lon_offset = pr.int64 ();
+                break;
+            default:
+                pr.skip ();
+        }
+    }
+
+    for (auto g: groups)
+        decode_group (g, st, gran, block);
+}
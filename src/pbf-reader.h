@@ -0,0 +1,199 @@
+/***************************************************************************
+ *  Project:    osmdata
+ *  File:       pbf-reader.h
+ *  Language:   C++
+ *
+ *  osmdata is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  osmdata is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along with
+ *  osm-router.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Author:     Mark Padgham
+ *  E-Mail:     mark.padgham@email.com
+ *
+ *  Description:    Decoder for the OSM PBF format
+ *                  (https://wiki.openstreetmap.org/wiki/PBF_Format), producing
+ *                  the same RawNode/RawWay/RawRelation structures that are
+ *                  read from OSM XML.
+ *
+ *  Limitations:    Only uncompressed and zlib-compressed blobs are supported.
+ *                  Element metadata (Info/DenseInfo) are not read.
+ *
+ *  Dependencies:       zlib
+ *
+ *  Compiler Options:   -std=c++11
+ ***************************************************************************/
+
+#pragma once
+
+#include "common.h"
+
+#include <cstdint>
+
+namespace pbf {
+
+/************************************************************************
+ ************************************************************************
+ **                                                                    **
+ **                        CLASS::PROTOREADER                          **
+ **                                                                    **
+ ************************************************************************
+ ************************************************************************
+ *
+ * Minimal reader for the protobuf wire format. Fields are iterated with
+ * `next ()`, after which exactly one of the value accessors (or `skip ()`)
+ * must be called.
+ */
+
+class ProtoReader
+{
+    private:
+
+        const uint8_t * m_p;
+        const uint8_t * m_end;
+        uint32_t m_tag = 0, m_wire = 0;
+
+    public:
+
+        ProtoReader (const char * data, size_t len)
+            : m_p (reinterpret_cast <const uint8_t *> (data)),
+              m_end (reinterpret_cast <const uint8_t *> (data) + len) {}
+
+        bool at_end () const { return m_p >= m_end; }
+
+        bool next ()
+        {
+            if (m_p >= m_end)
+                return false;
+            const uint64_t key = varint ();
+            m_tag = static_cast <uint32_t> (key >> 3);
+            m_wire = static_cast <uint32_t> (key & 0x07);
+            return true;
+        }
+
+        uint32_t tag () const { return m_tag; }
+        uint32_t wire_type () const { return m_wire; }
+
+        uint64_t varint ()
+        {
+            // Single-byte values are by far the most common
+            if (m_p < m_end && *m_p < 0x80)
+                return *m_p++;
+
+            uint64_t res = 0;
+            for (int shift = 0; shift < 64; shift += 7)
+            {
+                if (m_p >= m_end)
+                    throw std::runtime_error ("corrupt PBF data");
+                const uint8_t b = *m_p++;
+                res |= static_cast <uint64_t> (b & 0x7F) << shift;
+                if (b < 0x80)
+                    return res;
+            }
+            throw std::runtime_error ("corrupt PBF data");
+        }
+
+        int64_t int64 () { return static_cast <int64_t> (varint ()); }
+
+        int64_t sint64 ()
+        {
+            const uint64_t v = varint ();
+            return static_cast <int64_t> (v >> 1) ^
+                -static_cast <int64_t> (v & 1);
+        }
+
+        // Length-delimited fields: bytes, strings, sub-messages and packed
+        // repeated fields
+        void bytes (const char * &data, size_t &len)
+        {
+            const uint64_t n = varint ();
+            if (n > static_cast <uint64_t> (m_end - m_p))
+                throw std::runtime_error ("corrupt PBF data");
+            data = reinterpret_cast <const char *> (m_p);
+            len = static_cast <size_t> (n);
+            m_p += len;
+        }
+
+        std::string string ()
+        {
+            const char * data;
+            size_t len;
+            bytes (data, len);
+            return std::string (data, len);
+        }
+
+        ProtoReader message ()
+        {
+            const char * data;
+            size_t len;
+            bytes (data, len);
+            return ProtoReader (data, len);
+        }
+
+        void skip ()
+        {
+            size_t n = 0;
+            switch (m_wire)
+            {
+                case 0:
+                    varint ();
+                    return;
+                case 1:
+                    n = 8;
+                    break;
+                case 2:
+                    {
+                        const char * data;
+                        bytes (data, n);
+                        return;
+                    }
+                case 5:
+                    n = 4;
+                    break;
+                default:
+                    throw std::runtime_error ("unsupported PBF wire type");
+            }
+            if (n > static_cast <size_t> (m_end - m_p))
+                throw std::runtime_error ("corrupt PBF data");
+            m_p += n;
+        }
+};
+
+/************************************************************************
+ ************************************************************************
+ **                                                                    **
+ **                         PBF FILE STRUCTURES                        **
+ **                                                                    **
+ ************************************************************************
+ ************************************************************************/
+
+// A single Blob of a PBF file, referring to the still-compressed data within
+// the input buffer.
+struct BlobRef
+{
+    bool is_header; // "OSMHeader" rather than "OSMData"
+    const char * data; // start of the Blob message
+    size_t size;
+};
+
+bool is_pbf (const char * begin, const char * end);
+
+std::vector <BlobRef> split_blobs (const char * begin, const char * end);
+
+void blob_data (const BlobRef &blob, std::vector <char> &buf,
+        const char * &data, size_t &len);
+
+void decode_header (const char * data, size_t len, OsmMeta &meta);
+
+void decode_block (const char * data, size_t len, RawBlock &block,
+        const ParseOptions &opts);
+
+} // end namespace pbf
@@ -0,0 +1,50 @@
+/***************************************************************************
+ *  Project:    osmdata
+ *  File:       threads.h
+ *  Language:   C++
+ *
+ *  osmdata is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  osmdata is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along with
+ *  osm-router.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Author:     Mark Padgham
+ *  E-Mail:     mark.padgham@email.com
+ *
+ *  Description:    Thin wrappers around OpenMP, so that code also compiles
+ *                  (and runs single-threaded) where OpenMP is not available.
+ *
+ *  Limitations:
+ *
+ *  Dependencies:       OpenMP (optional)
+ *
+ *  Compiler Options:   -std=c++11 $(SHLIB_OPENMP_CXXFLAGS)
+ ***************************************************************************/
+
+#pragma once
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace osm_threads {
+
+// Number of threads used by default, which respects OMP_NUM_THREADS
+inline int max_threads ()
+{
+#ifdef _OPENMP
+    return omp_get_max_threads ();
+#else
+    return 1;
+#endif
+}
+
+} // end namespace osm_threads
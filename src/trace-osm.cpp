@@ -24,34 +24,69 @@
  *
  *  Limitations:
  *
- *  Dependencies:       none (rapidXML header included in osmdata)
+ *  Dependencies:       none
  *
  *  Compiler Options:   -std=c++11
  ***************************************************************************/
 
 #include "trace-osm.h"
 
-/* Traces a single relation of any type (SC only)
+namespace {
+
+/* Positions of the member ways of a relation, indexed by the ids of their end
+ * nodes, so that the ways adjoining any node are found without scanning all
+ * members. The positions for each node are in order of membership. */
+typedef std::unordered_map <osmid_t, std::vector <size_t> > EndpointIndex;
+
+/* Index the end nodes of all member ways of a relation. Members which are not
+ * present in `ways` are not indexed.
  *
- * @param itr_rel iterator to XmlData::Relations structure
+ * @param members Member ways of the relation
+ * @param &ways pointer to Ways structure
+ * @param &way_its Filled with iterators to each member in `ways`, or
+ *        `ways.end ()` for those not present
+ * @param &endpoints Filled with index of the end nodes of each member
  */
-void trace_relation (Relations::const_iterator &itr_rel,
-        osm_str_vec &relation_ways, 
-        std::vector <std::pair <std::string, std::string> > & relation_kv)
+void index_endpoints (const RelMembers &members, const Ways &ways,
+        std::vector <Ways::const_iterator> &way_its, EndpointIndex &endpoints)
+{
+    way_its.resize (members.size ());
+    endpoints.reserve (2 * members.size ());
+    for (size_t i = 0; i < members.size (); i++)
+    {
+        way_its [i] = ways.find (members [i].first);
+        if (way_its [i] == ways.end ())
+            continue;
+        const auto &way_nodes = way_its [i]->second.nodes;
+        endpoints [way_nodes.front ()].push_back (i);
+        if (way_nodes.back () != way_nodes.front ())
+            endpoints [way_nodes.back ()].push_back (i);
+    }
+}
+
+/* The first untraced member way adjoining `node`, or `traced.size ()` if there
+ * is none. */
+size_t next_adjoining (const EndpointIndex &endpoints, osmid_t node,
+        const std::vector <bool> &traced)
 {
-    relation_ways.reserve (itr_rel->ways.size ());
-    for (auto itw = itr_rel->ways.begin (); itw != itr_rel->ways.end (); ++itw)
-            relation_ways.push_back (std::make_pair (itw->first, itw->second));
-
-    relation_kv.reserve (itr_rel->key_val.size ());
-    for (auto itk = itr_rel->key_val.begin ();
-            itk != itr_rel->key_val.end (); ++itk)
-        relation_kv.push_back (std::make_pair (itk->first, itk->second));
+    auto ep = endpoints.find (node);
+    if (ep != endpoints.end ())
+        for (auto j: ep->second)
+            if (!traced [j])
+                return j;
+    return traced.size ();
 }
 
+} // end anonymous namespace
 
 /* Traces a single multipolygon relation 
  * 
+ * Rings are started from the first untraced "outer" way, or if there are none,
+ * the first untraced way of any role. They are then extended by the first
+ * untraced way of the same role which adjoins the current end node, found
+ * through an index of the end nodes of all member ways, until they close.
+ * Rings which can not be closed are discarded.
+ *
  * @param itr_rel iterator to XmlData::Relations structure
  * @param &ways pointer to Ways structure
  * @param &nodes pointer to Nodes structure
@@ -64,99 +99,195 @@ void trace_multipolygon (Relations::const_iterator &itr_rel, const Ways &ways,
         const Nodes &nodes, double_arr2 &lon_vec, double_arr2 &lat_vec,
         string_arr2 &rowname_vec, std::vector <std::string> &ids)
 {
-    bool closed, ptr_check;
-    osmid_t node0, first_node, last_node;
-    std::string this_role;
-    std::stringstream this_way;
-    std::vector <double> lons, lats;
-    std::vector <std::string> rownames, wayname_vec;
+    const RelMembers &members = itr_rel->ways;
+    const size_t nways = members.size ();
+    std::vector <Ways::const_iterator> way_its;
+    EndpointIndex endpoints;
+    index_endpoints (members, ways, way_its, endpoints);
+    for (auto &w: way_its)
+        if (w == ways.end ())
+            throw std::runtime_error ("way can not be found");
 
-    osm_str_vec relation_ways;
-    relation_ways.reserve (itr_rel->ways.size ());
-    for (auto itw = itr_rel->ways.begin (); itw != itr_rel->ways.end (); ++itw)
-        relation_ways.push_back (std::make_pair (itw->first, itw->second));
-    it_osm_str_vec itr_rw;
+    std::vector <bool> traced (nways, false);
+    size_t ntraced = 0, next_outer = 0, next_any = 0;
+    std::vector <double> lons, lats;
+    std::vector <std::string> rownames;
 
-    bool way_okay = true;
-    // Then trace through all those relations and store associated data
-    while (relation_ways.size () > 0)
+    while (ntraced < nways)
     {
-        auto rwi = relation_ways.begin ();
-        if (rwi->second != "outer") // "outer" role first 
-        {
-            while (std::distance (rwi, relation_ways.end ()) > 1)
-            {
-                std::advance (rwi, 1);
-                if (rwi->second == "outer")
-                    break;
-            }
-            if (rwi->second != "outer") // just reset to first
-                rwi = relation_ways.begin ();
-        }
-        this_role = rwi->second;
-        auto wayi = ways.find (rwi->first);
-        if (wayi == ways.end ())
-            throw std::runtime_error ("way can not be found");
-        this_way.str ("");
-        this_way << std::to_string (rwi->first);
-        relation_ways.erase (rwi);
-
-        // Get first way of relation, and starting node
-        node0 = wayi->second.nodes.front ();
-        last_node = trace_way (ways, nodes, node0,
-                wayi->first, lons, lats, rownames, false);
-        closed = false;
-        if (last_node == node0)
-            closed = true;
-        while (!closed)
+        // "outer" role first 
+        while (next_outer < nways && (traced [next_outer] ||
+                    members [next_outer].second != "outer"))
+            next_outer++;
+        while (traced [next_any])
+            next_any++;
+        const size_t wi = (next_outer < nways) ? next_outer : next_any;
+        traced [wi] = true;
+        ntraced++;
+        const std::string &this_role = members [wi].second;
+        std::string this_way = std::to_string (members [wi].first);
+
+        // Get first way of ring, and starting node
+        const osmid_t node0 = way_its [wi]->second.nodes.front ();
+        osmid_t last_node = trace_way (ways, nodes, node0,
+                way_its [wi]->first, lons, lats, rownames, false);
+        bool way_okay = true;
+        while (last_node != node0 && ntraced < nways)
         {
-            first_node = last_node;
-            ptr_check = false;
-            for (auto itw = relation_ways.begin ();
-                    itw != relation_ways.end (); ++itw)
-            {
-                if (itw->second == this_role)
-                {
-                    auto wayj = ways.find (itw->first);
-                    if (wayj == ways.end ())
-                        throw std::runtime_error ("way can not be found");
-                    last_node = trace_way (ways, nodes, first_node,
-                            wayj->first, lons, lats, rownames, true);
-                    this_way << "-" << std::to_string (wayj->first);
-                    if (last_node >= 0)
+            size_t wj = nways;
+            auto ep = endpoints.find (last_node);
+            if (ep != endpoints.end ())
+                for (auto j: ep->second)
+                    if (!traced [j] && members [j].second == this_role)
                     {
-                        first_node = last_node;
-                        itr_rw = itw;
-                        ptr_check = true;
+                        wj = j;
                         break;
                     }
-                }
-            } // end for itw over relation_ways
-            if (ptr_check)
-                relation_ways.erase (itr_rw);
-            else
+            if (wj == nways)
             {
                 // not all OSM multipolygons join up
                 way_okay = false;
                 break;
-                //throw std::runtime_error ("pointer not assigned");
             }
-            if (last_node == node0 || relation_ways.size () == 0)
-                closed = true;
-        } // end while !closed
+            traced [wj] = true;
+            ntraced++;
+            last_node = trace_way (ways, nodes, last_node,
+                    way_its [wj]->first, lons, lats, rownames, true);
+            this_way += "-" + std::to_string (members [wj].first);
+        } // end while ring not closed
         if (way_okay && last_node == node0)
         {
             lon_vec.push_back (lons);
             lat_vec.push_back (lats);
             rowname_vec.push_back (rownames);
-            wayname_vec.push_back (this_way.str ());
-            ids.push_back (this_way.str ());
+            ids.push_back (this_way);
         } 
         lats.clear (); // These can't be reserved here
         lons.clear ();
         rownames.clear ();
-    } // end while relation_ways.size == 0 - finished tracing relation
-    wayname_vec.clear ();
+    } // end while ntraced < nways - finished tracing relation
+}
+
+
+/* Nesting of the traced rings of a multipolygon relation into polygons
+ *
+ * Roles are not used here, as they are frequently wrong. Each ring is instead
+ * assigned to the smallest ring which contains it. Rings within an even number
+ * of others (including none) are the outer rings of polygons, while those
+ * within an odd number are inner rings of the polygon of the ring containing
+ * them. Rings are processed in decreasing order of area, so that all rings
+ * which may contain a ring are already known. These are found from a grid of
+ * ring bounding boxes, and confirmed with a point-in-ring test.
+ *
+ * @param &lon_vec pointer to 2D array of longitudes of each ring
+ * @param &lat_vec pointer to 2D array of latitudes of each ring
+ *
+ * @return Indices of the rings of each polygon, with the outer ring first.
+ *         Polygons are in order of their outer rings, and inner rings in order
+ *         within each polygon.
+ */
+std::vector <std::vector <size_t> > nest_rings (const double_arr2 &lon_vec,
+        const double_arr2 &lat_vec)
+{
+    const size_t n = lon_vec.size ();
+    std::vector <double> xmin (n, DOUBLE_MAX), xmax (n, -DOUBLE_MAX),
+        ymin (n, DOUBLE_MAX), ymax (n, -DOUBLE_MAX), area (n, 0.0);
+    double gxmin = DOUBLE_MAX, gxmax = -DOUBLE_MAX,
+           gymin = DOUBLE_MAX, gymax = -DOUBLE_MAX;
+    for (size_t i = 0; i < n; i++)
+    {
+        const std::vector <double> &x = lon_vec [i], &y = lat_vec [i];
+        for (size_t k = 0; k < x.size (); k++)
+        {
+            xmin [i] = std::min (xmin [i], x [k]);
+            xmax [i] = std::max (xmax [i], x [k]);
+            ymin [i] = std::min (ymin [i], y [k]);
+            ymax [i] = std::max (ymax [i], y [k]);
+            const size_t k1 = (k + 1) % x.size ();
+            area [i] += x [k] * y [k1] - x [k1] * y [k];
+        }
+        area [i] = std::fabs (area [i]);
+        gxmin = std::min (gxmin, xmin [i]);
+        gxmax = std::max (gxmax, xmax [i]);
+        gymin = std::min (gymin, ymin [i]);
+        gymax = std::max (gymax, ymax [i]);
+    }
+
+    std::vector <size_t> order (n);
+    for (size_t i = 0; i < n; i++)
+        order [i] = i;
+    std::stable_sort (order.begin (), order.end (),
+            [&area] (size_t a, size_t b) { return area [a] > area [b]; });
+
+    // Grid of about one cell per ring, each listing the rings whose bounding
+    // boxes overlap it, in decreasing order of area
+    const size_t ng = std::max (static_cast <size_t> (1),
+            static_cast <size_t> (std::ceil (std::sqrt (n))));
+    const double dx = (gxmax > gxmin) ? (gxmax - gxmin) / ng : 1.0,
+          dy = (gymax > gymin) ? (gymax - gymin) / ng : 1.0;
+    auto cell = [ng] (double v, double v0, double dv) {
+        const double c = std::floor ((v - v0) / dv);
+        return c < 0.0 ? 0 : std::min (static_cast <size_t> (c), ng - 1);
+    };
+    std::vector <std::vector <size_t> > grid (ng * ng);
+
+    // Whether ring j contains ring i, judged by the first vertex of i which
+    // does not lie on j. Identical rings do not contain one another.
+    auto contains = [&lon_vec, &lat_vec] (size_t j, size_t i) {
+        for (size_t k = 0; k < lon_vec [i].size (); k++)
+        {
+            const int pip = point_in_polygon (lon_vec [i][k], lat_vec [i][k],
+                    lon_vec [j], lat_vec [j]);
+            if (pip < 2)
+                return pip == 1;
+        }
+        return false;
+    };
+
+    std::vector <long int> parent (n, -1);
+    std::vector <size_t> depth (n, 0), candidates;
+    for (auto i: order)
+    {
+        if (lon_vec [i].empty ())
+            continue;
+        const size_t c = cell (lon_vec [i][0], gxmin, dx) +
+            ng * cell (lat_vec [i][0], gymin, dy);
+        candidates.clear ();
+        for (auto j: grid [c])
+            if (xmin [j] <= xmin [i] && xmax [j] >= xmax [i] &&
+                    ymin [j] <= ymin [i] && ymax [j] >= ymax [i])
+                candidates.push_back (j);
+        // Smallest containing ring first
+        for (auto j = candidates.rbegin (); j != candidates.rend (); ++j)
+            if (contains (*j, i))
+            {
+                parent [i] = static_cast <long int> (*j);
+                depth [i] = depth [*j] + 1;
+                break;
+            }
+
+        const size_t cx0 = cell (xmin [i], gxmin, dx),
+              cx1 = cell (xmax [i], gxmin, dx),
+              cy0 = cell (ymin [i], gymin, dy),
+              cy1 = cell (ymax [i], gymin, dy);
+        for (size_t cy = cy0; cy <= cy1; cy++)
+            for (size_t cx = cx0; cx <= cx1; cx++)
+                grid [cx + ng * cy].push_back (i);
+    }
+
+    std::vector <std::vector <size_t> > polygons;
+    std::vector <size_t> polygon_of (n);
+    for (size_t i = 0; i < n; i++)
+        if (depth [i] % 2 == 0)
+        {
+            polygon_of [i] = polygons.size ();
+            polygons.push_back (std::vector <size_t> (1, i));
+        }
+    for (size_t i = 0; i < n; i++)
+        if (depth [i] % 2 == 1)
+            polygons [polygon_of [static_cast <size_t> (parent [i])]].push_back (i);
+
+    return polygons;
 }
 
 
@@ -167,6 +298,13 @@ void trace_multipolygon (Relations::const_iterator &itr_rel, const Ways &ways,
  * multistring for each separate relation role, resulting in as many multistrings
  * as there are roles.
  *
+ * If `merge` is true, ways which share end nodes are instead joined into the
+ * longest possible linestrings. Each linestring is started from the first
+ * untraced way, and extended first backwards and then forwards by the first
+ * untraced ways adjoining each end, found through an index of the end nodes of
+ * all member ways. Linestrings are identified by the ids of their starting
+ * ways.
+ *
  * @param itr_rel iterator to XmlData::Relations structure
  * @param role trace ways only matching this role in the relation
  * @param &ways pointer to Ways structure
@@ -175,48 +313,80 @@ void trace_multipolygon (Relations::const_iterator &itr_rel, const Ways &ways,
  * @param &lat_vec pointer to 2D array of latitutdes
  * @param &rowname_vec pointer to 2D array of rownames for each node.
  * @param &id_vec pointer to 2D array of OSM IDs for each way in relation
+ * @param merge join ways which share end nodes
  */
 void trace_multilinestring (Relations::const_iterator &itr_rel, 
         const std::string role, const Ways &ways, const Nodes &nodes, 
         double_arr2 &lon_vec, double_arr2 &lat_vec, string_arr2 &rowname_vec,
-        std::vector <osmid_t> &ids)
+        std::vector <osmid_t> &ids, const bool merge)
 {
     std::vector <double> lons, lats;
     std::vector <std::string> rownames;
 
-    osm_str_vec relation_ways;
-    //relation_ways.reserve (itr_rel->ways.size ());
-    for (auto itw = itr_rel->ways.begin (); itw != itr_rel->ways.end (); ++itw)
-        if (itw->second == role)
-            relation_ways.push_back (std::make_pair (itw->first, itw->second));
+    const RelMembers &members = itr_rel->ways;
+    const size_t nways = members.size ();
+    std::vector <Ways::const_iterator> way_its;
+    EndpointIndex endpoints;
+    if (merge)
+        index_endpoints (members, ways, way_its, endpoints);
 
-    // Then trace through all those relations and store associated data
-    while (relation_ways.size () > 0)
+    // Non-overpass OSM data sets can have way IDs in old changelogs that no
+    // longer exist; these are simply skipped but reading continues. Thanks
+    // @RobinLovelace
+    std::vector <bool> traced (nways);
+    for (size_t i = 0; i < nways; i++)
     {
-        auto rwi = relation_ways.begin ();
-        ids.push_back (rwi->first);
-        auto wayi = ways.find (rwi->first);
-        //if (wayi == ways.end ())
-        //    throw std::runtime_error ("way can not be found");
-        // Non-overpass OSM data sets can have way IDs in old changelogs that no
-        // longer exist; this clause ensures that they are simply skipped but
-        // reading continues. Thanks @RobinLovelace
-        if (wayi != ways.end ())
-        {
-            osmid_t first_node = wayi->second.nodes.front ();
-            first_node = trace_way (ways, nodes, first_node, 
-                    wayi->first, lons, lats, rownames, false);
+        if (!merge)
+            way_its.push_back (ways.find (members [i].first));
+        traced [i] = (members [i].second != role || way_its [i] == ways.end ());
+    }
 
-            lon_vec.push_back (lons);
-            lat_vec.push_back (lats);
-            rowname_vec.push_back (rownames);
+    std::vector <size_t> before;
+    for (size_t i = 0; i < nways; i++)
+    {
+        if (traced [i])
+            continue;
+        traced [i] = true;
+        ids.push_back (members [i].first);
+        const auto &way_nodes = way_its [i]->second.nodes;
 
-            lons.clear ();
-            lats.clear ();
-            rownames.clear ();
-            relation_ways.erase (rwi);
-        }
-    } // end while relation_ways.size > 0
+        // Ways preceding way i, in reverse order, and the first node of all
+        osmid_t first_node = way_nodes.front ();
+        before.clear ();
+        if (merge)
+            for (size_t j = next_adjoining (endpoints, first_node, traced);
+                    j < nways; j = next_adjoining (endpoints, first_node, traced))
+            {
+                traced [j] = true;
+                before.push_back (j);
+                const auto &wn = way_its [j]->second.nodes;
+                first_node = (wn.front () == first_node) ? wn.back () :
+                    wn.front ();
+            }
+
+        osmid_t last_node = first_node;
+        for (auto j = before.rbegin (); j != before.rend (); ++j)
+            last_node = trace_way (ways, nodes, last_node, way_its [*j]->first,
+                    lons, lats, rownames, j != before.rbegin ());
+        last_node = trace_way (ways, nodes, last_node, way_its [i]->first,
+                lons, lats, rownames, !before.empty ());
+        if (merge)
+            for (size_t j = next_adjoining (endpoints, last_node, traced);
+                    j < nways; j = next_adjoining (endpoints, last_node, traced))
+            {
+                traced [j] = true;
+                last_node = trace_way (ways, nodes, last_node,
+                        way_its [j]->first, lons, lats, rownames, true);
+            }
+
+        lon_vec.push_back (lons);
+        lat_vec.push_back (lats);
+        rowname_vec.push_back (rownames);
+
+        lons.clear ();
+        lats.clear ();
+        rownames.clear ();
+    } // end for i over member ways
 }
 
 
@@ -245,47 +415,33 @@ osmid_t trace_way (const Ways &ways, const Nodes &nodes, osmid_t first_node,
 {
     osmid_t last_node = -1;
     auto wayi = ways.find (wayi_id);
-    bool add_node = true;
-    if (append)
-        add_node = false;
-
-    // Alternative to the following is to pass iterators as .begin() or
-    // .rbegin() to a std::for_each, but const Ways and Nodes cannot then
-    // (easily) be passed to lambdas. TODO: Find a way
-    if (first_node < 0 || wayi->second.nodes.front () == first_node)
+
+    // Nodes are read by their indices, in either direction. When appending,
+    // the first node duplicates the last node of the previous way.
+    const OneWay &way = wayi->second;
+    const size_t n = way.nodes.size ();
+    if (first_node < 0 || way.nodes.front () == first_node)
     {
-        for (auto ni = wayi->second.nodes.begin ();
-                ni != wayi->second.nodes.end (); ++ni)
+        if (way.missing_nodes)
+            throw std::runtime_error ("node can not be found");
+        for (size_t i = append ? 1 : 0; i < n; i++)
         {
-            if (nodes.find (*ni) == nodes.end ())
-                throw std::runtime_error ("node can not be found");
-            if (!add_node)
-                add_node = true;
-            else
-            { 
-                lons.push_back (nodes.find (*ni)->second.lon);
-                lats.push_back (nodes.find (*ni)->second.lat);
-                rownames.push_back (std::to_string (*ni));
-            }
+            lons.push_back (nodes.lon (way.node_index [i]));
+            lats.push_back (nodes.lat (way.node_index [i]));
+            rownames.push_back (std::to_string (way.nodes [i]));
         }
-        last_node = wayi->second.nodes.back ();
-    } else if (wayi->second.nodes.back () == first_node)
+        last_node = way.nodes.back ();
+    } else if (way.nodes.back () == first_node)
     {
-        for (auto ni = wayi->second.nodes.rbegin ();
-                ni != wayi->second.nodes.rend (); ++ni)
+        if (way.missing_nodes)
+            throw std::runtime_error ("node can not be found");
+        for (size_t i = append ? 1 : 0; i < n; i++)
         {
-            if (nodes.find (*ni) == nodes.end ())
-                throw std::runtime_error ("node can not be found");
-            if (!add_node)
-                add_node = true;
-            else
-            {
-                lons.push_back (nodes.find (*ni)->second.lon);
-                lats.push_back (nodes.find (*ni)->second.lat);
-                rownames.push_back (std::to_string (*ni));
-            }
+            lons.push_back (nodes.lon (way.node_index [n - 1 - i]));
+            lats.push_back (nodes.lat (way.node_index [n - 1 - i]));
+            rownames.push_back (std::to_string (way.nodes [n - 1 - i]));
         }
-        last_node = wayi->second.nodes.front ();
+        last_node = way.nodes.front ();
     }
 
     return last_node;
@@ -24,7 +24,7 @@
  *
  *  Limitations:
  *
- *  Dependencies:       none (rapidXML header included in osmdata)
+ *  Dependencies:       none
  *
  *  Compiler Options:   -std=c++11
  ***************************************************************************/
@@ -33,18 +33,17 @@
 
 #include "common.h"
 
-void trace_relation (Relations::const_iterator &itr_rel,
-        osm_str_vec &relation_ways, 
-        std::vector <std::pair <std::string, std::string> > & relation_kv);
-
 void trace_multipolygon (Relations::const_iterator &itr_rel, const Ways &ways,
         const Nodes &nodes, double_arr2 &lon_vec, double_arr2 &lat_vec,
         string_arr2 &rowname_vec, std::vector <std::string> &ids);
 
+std::vector <std::vector <size_t> > nest_rings (const double_arr2 &lon_vec,
+        const double_arr2 &lat_vec);
+
 void trace_multilinestring (Relations::const_iterator &itr_rel, 
         const std::string role, const Ways &ways, const Nodes &nodes, 
         double_arr2 &lon_vec, double_arr2 &lat_vec, string_arr2 &rowname_vec,
-        std::vector <osmid_t> &ids);
+        std::vector <osmid_t> &ids, const bool merge);
 
 osmid_t trace_way (const Ways &ways, const Nodes &nodes, osmid_t first_node,
         const osmid_t &wayi_id, std::vector <double> &lons, 
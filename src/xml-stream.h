@@ -0,0 +1,389 @@
+/***************************************************************************
+ *  Project:    osmdata
+ *  File:       xml-stream.h
+ *  Language:   C++
+ *
+ *  osmdata is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  osmdata is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along with
+ *  osm-router.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Author:     Mark Padgham
+ *  E-Mail:     mark.padgham@email.com
+ *
+ *  Description:    Streaming (SAX-style) scanner for OSM XML. Elements are
+ *                  reported to a handler as they are scanned, so no DOM is
+ *                  ever constructed. The input buffer is never modified.
+ *
+ *  Limitations:    Only the subset of XML used by OSM is supported: text
+ *                  content is skipped, and DOCTYPE internal subsets are not
+ *                  parsed.
+ *
+ *  Dependencies:       parse-num.h
+ *
+ *  Compiler Options:   -std=c++11
+ ***************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <stdexcept>
+
+#include "parse-num.h"
+
+namespace xml_stream {
+
+/* A single attribute, held as non-owning pointers into the input buffer.
+ * Values are returned raw; `str ()` translates character entities in the
+ * same way as rapidxml does with `parse<0>`. Numeric values are parsed in
+ * place by `to_integer ()` and `to_double ()` without any copying.
+ */
+struct Attr
+{
+    const char * name;
+    size_t name_len;
+    const char * value;
+    size_t value_len;
+
+    bool name_is (const char * nm) const
+    {
+        return strlen (nm) == name_len && !strncmp (name, nm, name_len);
+    }
+
+    bool value_is (const char * val) const
+    {
+        return strlen (val) == value_len && !strncmp (value, val, value_len);
+    }
+
+    // Whether `str ()` differs from the raw value
+    bool has_entities () const
+    {
+        return memchr (value, '&', value_len) != nullptr;
+    }
+
+    std::string str () const;
+
+    long long to_integer () const
+    {
+        return parse_num::parse_integer (value, value_len);
+    }
+
+    double to_double () const
+    {
+        return parse_num::parse_double (value, value_len);
+    }
+};
+
+typedef std::vector <Attr> Attrs;
+
+// Append the UTF-8 encoding of code point `cp` to `out`
+inline void append_utf8 (unsigned long cp, std::string &out)
+{
+    if (cp < 0x80)
+        out.push_back (static_cast <char> (cp));
+    else if (cp < 0x800)
+    {
+        out.push_back (static_cast <char> (0xC0 | (cp >> 6)));
+        out.push_back (static_cast <char> (0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000)
+    {
+        out.push_back (static_cast <char> (0xE0 | (cp >> 12)));
+        out.push_back (static_cast <char> (0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back (static_cast <char> (0x80 | (cp & 0x3F)));
+    } else
+    {
+        out.push_back (static_cast <char> (0xF0 | (cp >> 18)));
+        out.push_back (static_cast <char> (0x80 | ((cp >> 12) & 0x3F)));
+        out.push_back (static_cast <char> (0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back (static_cast <char> (0x80 | (cp & 0x3F)));
+    }
+}
+
+inline std::string Attr::str () const
+{
+    const char * amp = static_cast <const char *> (memchr (value, '&', value_len));
+    if (amp == nullptr)
+        return std::string (value, value_len);
+
+    std::string out (value, static_cast <size_t> (amp - value));
+    out.reserve (value_len);
+    const char * p = amp, * end = value + value_len;
+    while (p < end)
+    {
+        if (*p != '&')
+        {
+            out.push_back (*p++);
+            continue;
+        }
+        const char * semi = static_cast <const char *> (
+                memchr (p, ';', static_cast <size_t> (end - p)));
+        if (semi == nullptr)
+        {
+            // unterminated entities are left as-is
+            out.append (p, static_cast <size_t> (end - p));
+            break;
+        }
+        std::string ent (p + 1, static_cast <size_t> (semi - p - 1));
+        if (ent == "amp")
+            out.push_back ('&');
+        else if (ent == "lt")
+            out.push_back ('<');
+        else if (ent == "gt")
+            out.push_back ('>');
+        else if (ent == "quot")
+            out.push_back ('"');
+        else if (ent == "apos")
+            out.push_back ('\'');
+        else if (ent.size () > 1 && ent [0] == '#')
+        {
+            unsigned long cp = 0;
+            bool hex = (ent [1] == 'x');
+            for (size_t i = hex ? 2 : 1; i < ent.size (); i++)
+            {
+                char c = ent [i];
+                if (c >= '0' && c <= '9')
+                    cp = cp * (hex ? 16 : 10) + static_cast <unsigned long> (c - '0');
+                else if (hex && c >= 'a' && c <= 'f')
+                    cp = cp * 16 + static_cast <unsigned long> (c - 'a' + 10);
+                else if (hex && c >= 'A' && c <= 'F')
+                    cp = cp * 16 + static_cast <unsigned long> (c - 'A' + 10);
+            }
+            append_utf8 (cp, out);
+        } else // unknown entities are also left as-is
+            out.append (p, static_cast <size_t> (semi - p + 1));
+        p = semi + 1;
+    }
+    return out;
+}
+
+
+/************************************************************************
+ ************************************************************************
+ **                                                                    **
+ **                           CLASS::PARSER                            **
+ **                                                                    **
+ ************************************************************************
+ ************************************************************************
+ *
+ * The Handler must provide the two member functions:
+ *
+ *   void start_element (const char * name, size_t len, const Attrs &attrs);
+ *   void end_element (const char * name, size_t len);
+ *
+ * Self-closing elements trigger both calls in immediate succession.
+ */
+
+template <typename Handler>
+class Parser
+{
+    private:
+
+        Handler &m_handler;
+        Attrs m_attrs; // re-used for every element to avoid allocation
+
+    public:
+
+        Parser (Handler &handler) : m_handler (handler) {}
+
+        void parse (const char * begin, const char * end);
+
+    private:
+
+        static bool is_space (char c)
+        {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+        }
+
+        static const char * skip_past (const char * p, const char * end,
+                const char * pattern);
+
+        const char * start_tag (const char * p, const char * end);
+        const char * end_tag (const char * p, const char * end);
+};
+
+template <typename Handler>
+inline const char * Parser <Handler>::skip_past (const char * p,
+        const char * end, const char * pattern)
+{
+    const size_t n = strlen (pattern);
+    while (p < end)
+    {
+        p = static_cast <const char *> (memchr (p, pattern [0],
+                    static_cast <size_t> (end - p)));
+        if (p == nullptr || static_cast <size_t> (end - p) < n)
+            break;
+        if (!strncmp (p, pattern, n))
+            return p + n;
+        p++;
+    }
+    throw std::runtime_error ("unterminated XML construct");
+}
+
+template <typename Handler>
+inline void Parser <Handler>::parse (const char * begin, const char * end)
+{
+    const char * p = begin;
+    while (p < end)
+    {
+        p = static_cast <const char *> (memchr (p, '<',
+                    static_cast <size_t> (end - p)));
+        if (p == nullptr)
+            break;
+        p++;
+        if (p >= end)
+            throw std::runtime_error ("unexpected end of XML data");
+
+        if (*p == '?') // declaration or processing instruction
+            p = skip_past (p, end, "?>");
+        else if (*p == '!')
+        {
+            if (end - p >= 3 && !strncmp (p, "!--", 3))
+                p = skip_past (p + 3, end, "-->");
+            else if (end - p >= 8 && !strncmp (p, "![CDATA[", 8))
+                p = skip_past (p + 8, end, "]]>");
+            else // DOCTYPE
+                p = skip_past (p, end, ">");
+        } else if (*p == '/')
+            p = end_tag (p + 1, end);
+        else
+            p = start_tag (p, end);
+    }
+}
+
+template <typename Handler>
+inline const char * Parser <Handler>::end_tag (const char * p,
+        const char * end)
+{
+    const char * name = p;
+    while (p < end && *p != '>' && !is_space (*p))
+        p++;
+    const size_t len = static_cast <size_t> (p - name);
+    p = static_cast <const char *> (memchr (p, '>',
+                static_cast <size_t> (end - p)));
+    if (p == nullptr)
+        throw std::runtime_error ("unterminated XML end tag");
+    m_handler.end_element (name, len);
+    return p + 1;
+}
+
+template <typename Handler>
+inline const char * Parser <Handler>::start_tag (const char * p,
+        const char * end)
+{
+    const char * name = p;
+    while (p < end && *p != '>' && *p != '/' && !is_space (*p))
+        p++;
+    const size_t len = static_cast <size_t> (p - name);
+
+    m_attrs.clear ();
+    bool empty = false;
+    while (true)
+    {
+        while (p < end && is_space (*p))
+            p++;
+        if (p >= end)
+            throw std::runtime_error ("unterminated XML start tag");
+        if (*p == '>')
+        {
+            p++;
+            break;
+        } else if (*p == '/')
+        {
+            if (p + 1 >= end || *(p + 1) != '>')
+                throw std::runtime_error ("malformed XML start tag");
+            empty = true;
+            p += 2;
+            break;
+        }
+
+        Attr a;
+        a.name = p;
+        while (p < end && *p != '=' && !is_space (*p))
+            p++;
+        a.name_len = static_cast <size_t> (p - a.name);
+        while (p < end && is_space (*p))
+            p++;
+        if (p >= end || *p != '=')
+            throw std::runtime_error ("malformed XML attribute");
+        p++;
+        while (p < end && is_space (*p))
+            p++;
+        if (p >= end || (*p != '"' && *p != '\''))
+            throw std::runtime_error ("malformed XML attribute");
+        const char quote = *p++;
+        a.value = p;
+        p = static_cast <const char *> (memchr (p, quote,
+                    static_cast <size_t> (end - p)));
+        if (p == nullptr)
+            throw std::runtime_error ("unterminated XML attribute");
+        a.value_len = static_cast <size_t> (p - a.value);
+        p++;
+        m_attrs.push_back (a);
+    }
+
+    m_handler.start_element (name, len, m_attrs);
+    if (empty)
+        m_handler.end_element (name, len);
+
+    return p;
+}
+
+/* Split [begin, end) into chunks of approximately `chunk_size` bytes, each
+ * starting with the opening tag of one of the named elements. The returned
+ * vector holds the start of each chunk, followed by `end`.
+ *
+ * Tags are recognised without regard to context, so a boundary may fall
+ * within a comment or CDATA section. Parsing the chunk preceding such a
+ * boundary will then fail with an "unterminated XML construct" error, and the
+ * whole buffer should instead be parsed in one piece.
+ */
+inline std::vector <const char *> split_at_elements (const char * begin,
+        const char * end, size_t chunk_size,
+        const std::vector <std::string> &names)
+{
+    std::vector <const char *> bounds;
+    bounds.push_back (begin);
+    const char * p = begin + chunk_size;
+    while (p < end)
+    {
+        p = static_cast <const char *> (memchr (p, '<',
+                    static_cast <size_t> (end - p)));
+        if (p == nullptr)
+            break;
+        bool found = false;
+        for (const auto &nm: names)
+        {
+            const size_t n = nm.size ();
+            if (static_cast <size_t> (end - p) > n + 1 &&
+                    !strncmp (p + 1, nm.c_str (), n) &&
+                    (p [n + 1] == ' ' || p [n + 1] == '>' ||
+                     p [n + 1] == '/' || p [n + 1] == '\t' ||
+                     p [n + 1] == '\n' || p [n + 1] == '\r'))
+            {
+                found = true;
+                break;
+            }
+        }
+        if (found)
+        {
+            bounds.push_back (p);
+            p += chunk_size;
+        } else
+            p++;
+    }
+    bounds.push_back (end);
+
+    return bounds;
+}
+
+} // end namespace xml_stream